@@ -7,7 +7,7 @@ out vec4 finalColor;
 
 uniform vec2 lightPos;
 uniform vec2 resolution;
-uniform sampler2D lightTexture; // Your render texture
+uniform sampler2D lightTexture; // Your render texture, possibly smaller than the screen (bilinear upsampled)
 uniform float time;
 
 // Simple pseudo-random hash based on position and time
@@ -19,7 +19,10 @@ float rand(vec2 co, float t)
 void main()
 {
     vec2 flippedTexCoord = vec2(fragTexCoord.x, 1.0 - fragTexCoord.y);
-    float lightValue = texture(lightTexture, flippedTexCoord).r;
+    vec3 lightSample = texture(lightTexture, flippedTexCoord).rgb;
+    // the player's sight is drawn white, other lights add their own (dimmer) color
+    float lightValue = min(lightSample.r, min(lightSample.g, lightSample.b));
+    float otherLight = max(lightSample.r, max(lightSample.g, lightSample.b));
 
     // if (lightValue > 0.5) {
     //     finalColor = vec4(0,0,0,0);
@@ -27,11 +30,9 @@ void main()
     //     finalColor = vec4(0,0,0,1);
     // }
 
-    int screenHeight = 800;
-    int screenWidth = 800;
     float ambientDarkness = 0.7;
     
-    vec2 fragPos = vec2(gl_FragCoord.x, screenHeight - gl_FragCoord.y);
+    vec2 fragPos = vec2(gl_FragCoord.x, resolution.y - gl_FragCoord.y);
     
     // float distance = length(fragPos - lightPos);
     // light oval
@@ -67,6 +68,13 @@ void main()
         finalColorRGB = mix(lightColor, ambientColor, fadeAmount);
         alpha = mix(0.3, ambientDarkness, fadeAmount);
     }
+    else if (otherLight > 0.0)
+    {
+        // Lit by another light - tint with its color
+        lightIntensity = otherLight;
+        finalColorRGB = mix(ambientColor, lightSample / otherLight, otherLight);
+        alpha = mix(ambientDarkness, 0.3, otherLight);
+    }
     else
     {
         // Outside light - dark ambient
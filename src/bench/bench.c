@@ -0,0 +1,603 @@
+/*
+Microbenchmarks: the hot functions on their own, over synthetic maps, without a window.
+Built and run with `make bench BUILD_MODE=RELEASE`, arguments go in BENCH_ARGS.
+
+    main_bench [-filter name] [-maps open,maze,noise,pillars] [-sizes 16,64,256,1024,4096]
+               [-reps N] [-time ms] [-json] [-baseline old.json] [-threshold percent] [-raycast grid|brute|simd]
+
+Every function runs in batches of about -time ms, after a warmup. The median of -reps batches is reported,
+with the min, mean and standard deviation. -json prints the results as JSON instead of a table, one result per line.
+-baseline compares against the JSON of an earlier run and exits with 1 if anything got more than
+-threshold percent slower (default 10). -raycast picks how calculateSightTriangles/rayFan casts its rays,
+the grid like the game unless told otherwise
+*/
+#include "raylib.h"
+#include "game_state.h"
+#include "world.h"
+#include "ray_casting.h"
+#include "edge_buffer.h"
+#include "frame_arena.h"
+#include "profiler.h"
+#include "stats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define DEFAULT_REPS 10
+#define DEFAULT_BATCH_MS 10.0
+#define DEFAULT_THRESHOLD 10.0
+// the warmup runs at least this long, and at least one op
+#define WARMUP_NS 50000000.0
+// ops slower than this only get a few reps, the big maps would take minutes otherwise
+#define SLOW_OP_NS 100000000.0
+#define SLOW_OP_REPS 3
+#define MAX_REPS 100
+// the game's sight range, screenWidth
+#define BENCH_RANGE 800.0f
+#define BENCH_ORIGINS 64
+#define BENCH_DIRECTIONS 256
+#define MAX_SIZES 16
+#define MAX_RESULTS 1024
+#define MAX_LINE 512
+
+typedef enum BenchMap
+{
+    MAP_OPEN,    // just the walls around the room
+    MAP_MAZE,    // corridors one tile wide
+    MAP_NOISE,   // 30% of the tiles are walls, at random
+    MAP_PILLARS, // 2x2 pillars every 6 tiles
+    MAP_COUNT
+} BenchMap;
+
+static const char *MAP_NAMES[MAP_COUNT] = {"open", "maze", "noise", "pillars"};
+
+// What the benchmarks share for one map: where rays start, and the edges in range of each start
+typedef struct BenchContext
+{
+    GameState *game;
+    Vector2 origins[BENCH_ORIGINS];
+    Edge *originEdges[BENCH_ORIGINS];
+    int originEdgeCounts[BENCH_ORIGINS];
+    Vector2 directions[BENCH_DIRECTIONS];
+    double checksum; // results are added here, so the compiler can't drop the work
+} BenchContext;
+
+// the checksum is stored here after every benchmark. volatile, so the store and the work behind it have to happen
+static volatile double benchSink;
+
+// Runs ops op, from firstOp on. Returns the work done (rays, edges, tiles...) by the ops
+typedef double (*BenchFunction)(BenchContext *context, int firstOp, int ops);
+
+typedef struct Benchmark
+{
+    const char *name;
+    BenchFunction run;
+    const char *unit; // of the work, per second
+} Benchmark;
+
+typedef struct BenchResult
+{
+    char name[64];
+    char map[16];
+    int size;
+    double nsPerOp; // median of the reps
+    double minNsPerOp;
+    double meanNsPerOp;
+    double stddevNsPerOp;
+    int reps;
+    int opsPerRep;
+    double throughput; // work per second, at the median
+    const char *unit;
+} BenchResult;
+
+// Small LCG, so the maps are the same on every platform
+static unsigned int nextRandom(unsigned int *state)
+{
+    *state = *state * 1664525u + 1013904223u;
+    return *state >> 8;
+}
+
+// Fill the room with a map, inside the two tile border loadRoomTiles puts around it
+static void generateBenchMap(GameState *game, BenchMap map, int size)
+{
+    loadRoomTiles(game, size, size);
+    unsigned int seed = 1234;
+    for (int y = 2; y < size - 2; y++)
+    {
+        for (int x = 2; x < size - 2; x++)
+        {
+            bool wall = false;
+            switch (map)
+            {
+            case MAP_MAZE:
+                // cells on odd tiles, the walls between them knocked out below
+                wall = x % 2 == 0 || y % 2 == 0;
+                break;
+            case MAP_NOISE:
+                wall = nextRandom(&seed) % 100 < 30;
+                break;
+            case MAP_PILLARS:
+                wall = x % 6 < 2 && y % 6 < 2;
+                break;
+            default:
+                break;
+            }
+            SetTileType(&GET_TILE(game, x, y), wall ? TILE_WALL : TILE_FLOOR);
+        }
+    }
+    if (map == MAP_MAZE)
+    {
+        // binary tree maze: every cell opens north or east, so they're all connected
+        for (int y = 3; y < size - 2; y += 2)
+        {
+            for (int x = 3; x < size - 2; x += 2)
+            {
+                bool canNorth = y - 2 >= 3;
+                bool canEast = x + 2 < size - 2;
+                if (canNorth && (!canEast || nextRandom(&seed) % 2 == 0))
+                    SetTileType(&GET_TILE(game, x, y - 1), TILE_FLOOR);
+                else if (canEast)
+                    SetTileType(&GET_TILE(game, x + 1, y), TILE_FLOOR);
+            }
+        }
+    }
+    computeRoomNeighborMasks(game);
+    roomTilesToRoomLines(game);
+}
+
+// Pick floor tiles to cast from, and gather the edges in range of each like the game does
+static void initBenchContext(BenchContext *context, GameState *game)
+{
+    for (int i = 0; i < BENCH_ORIGINS; i++)
+    {
+        free(context->originEdges[i]);
+    }
+    *context = (BenchContext){0};
+    context->game = game;
+    unsigned int seed = 99;
+    Edge *gathered = NULL;
+    int gatheredCapacity = 0;
+    for (int i = 0; i < BENCH_ORIGINS; i++)
+    {
+        // a random floor tile, or the middle of the room if none turns up
+        int tileX = game->roomWidth / 2;
+        int tileY = game->roomHeight / 2;
+        for (int attempt = 0; attempt < 100; attempt++)
+        {
+            int x = (int)(nextRandom(&seed) % game->roomWidth);
+            int y = (int)(nextRandom(&seed) % game->roomHeight);
+            if (GET_TILE(game, x, y).tileType == TILE_FLOOR)
+            {
+                tileX = x;
+                tileY = y;
+                break;
+            }
+        }
+        Vector2 origin = {(tileX + 0.5f) * game->tileSize, (tileY + 0.5f) * game->tileSize};
+        context->origins[i] = origin;
+        int edgeCount = gatherRoomEdges(game, origin, BENCH_RANGE, &gathered, &gatheredCapacity);
+        context->originEdges[i] = malloc((edgeCount + 1) * sizeof(Edge));
+        memcpy(context->originEdges[i], gathered, edgeCount * sizeof(Edge));
+        context->originEdgeCounts[i] = edgeCount;
+    }
+    free(gathered);
+    for (int i = 0; i < BENCH_DIRECTIONS; i++)
+    {
+        // off the axes, so rays don't run along the walls
+        float angle = (i + 0.37f) * 2.0f * PI / BENCH_DIRECTIONS;
+        context->directions[i] = (Vector2){cosf(angle), sinf(angle)};
+    }
+}
+
+static void freeBenchContext(BenchContext *context)
+{
+    for (int i = 0; i < BENCH_ORIGINS; i++)
+    {
+        free(context->originEdges[i]);
+        context->originEdges[i] = NULL;
+    }
+}
+
+static double benchRoomTilesToRoomLines(BenchContext *context, int firstOp, int ops)
+{
+    double edges = 0;
+    for (int op = 0; op < ops; op++)
+    {
+        roomTilesToRoomLines(context->game);
+        edges += context->game->roomEdgeCount;
+    }
+    return edges;
+}
+
+// Neighbour masks of every tile, then the tile frames for each. What drawing the room needs
+static double benchAutotile(BenchContext *context, int firstOp, int ops)
+{
+    GameState *game = context->game;
+    int tileCount = game->roomWidth * game->roomHeight;
+    for (int op = 0; op < ops; op++)
+    {
+        computeRoomNeighborMasks(game);
+        float sum = 0;
+        for (int i = 0; i < tileCount; i++)
+        {
+            sum += getTileCornersForMask(game->roomTiles[i].neighborMask).topLeft.x;
+        }
+        context->checksum += sum;
+    }
+    return (double)ops * tileCount;
+}
+
+// Brute force over the edges in range, see castRay
+static double benchCastRay(BenchContext *context, int firstOp, int ops)
+{
+    for (int op = firstOp; op < firstOp + ops; op++)
+    {
+        int origin = op % BENCH_ORIGINS;
+        Vector2 direction = context->directions[(op / BENCH_ORIGINS) % BENCH_DIRECTIONS];
+        Vector2 hit = castRay(context->origins[origin], direction, context->originEdges[origin], context->originEdgeCounts[origin], BENCH_RANGE);
+        context->checksum += hit.x;
+    }
+    return ops;
+}
+
+// Walking the tile grid over the whole room, what the game uses
+static double benchCastRayGrid(BenchContext *context, int firstOp, int ops)
+{
+    for (int op = firstOp; op < firstOp + ops; op++)
+    {
+        Vector2 direction = context->directions[(op / BENCH_ORIGINS) % BENCH_DIRECTIONS];
+        Vector2 hit = castRayGrid(context->game, context->origins[op % BENCH_ORIGINS], direction, BENCH_RANGE);
+        context->checksum += hit.x;
+    }
+    return ops;
+}
+
+// Every edge of the room with the SIMD kernel, what RAYCAST_SIMD uses
+static double benchCastRaySoA(BenchContext *context, int firstOp, int ops)
+{
+    for (int op = firstOp; op < firstOp + ops; op++)
+    {
+        Vector2 direction = context->directions[(op / BENCH_ORIGINS) % BENCH_DIRECTIONS];
+        Vector2 hit = castRaySoA(context->game->roomEdgeBuffer, context->origins[op % BENCH_ORIGINS], direction, BENCH_RANGE);
+        context->checksum += hit.x;
+    }
+    return ops;
+}
+
+// Same, every direction from one origin per op, the edges loaded once for all of them
+static double benchCastRaysBatch(BenchContext *context, int firstOp, int ops)
+{
+    Vector2 hits[BENCH_DIRECTIONS];
+    for (int op = firstOp; op < firstOp + ops; op++)
+    {
+        castRaysBatch(context->game->roomEdgeBuffer, context->origins[op % BENCH_ORIGINS], context->directions, BENCH_DIRECTIONS, BENCH_RANGE, hits);
+        context->checksum += hits[op % BENCH_DIRECTIONS].x;
+    }
+    return (double)ops * BENCH_DIRECTIONS;
+}
+
+static double benchSight(BenchContext *context, int firstOp, int ops, VisibilityAlgorithm algorithm)
+{
+    GameState *game = context->game;
+    game->visibilityAlgorithm = algorithm;
+    double edges = 0;
+    for (int op = firstOp; op < firstOp + ops; op++)
+    {
+        int origin = op % BENCH_ORIGINS;
+        resetFrameArena(game->frameArena);
+        // every op is a miss, as in a frame where the player moved
+        invalidateVisibilityCache(game);
+        calculateSightTriangles(context->origins[origin], context->originEdges[origin], context->originEdgeCounts[origin], BENCH_RANGE, game);
+        context->checksum += game->playerSight.triangleCount;
+        edges += context->originEdgeCounts[origin];
+    }
+    return edges;
+}
+
+static double benchSightSweep(BenchContext *context, int firstOp, int ops)
+{
+    return benchSight(context, firstOp, ops, VISIBILITY_ANGULAR_SWEEP);
+}
+
+static double benchSightRayFan(BenchContext *context, int firstOp, int ops)
+{
+    return benchSight(context, firstOp, ops, VISIBILITY_RAY_FAN);
+}
+
+static const Benchmark BENCHMARKS[] = {
+    {"roomTilesToRoomLines", benchRoomTilesToRoomLines, "edges/s"},
+    {"autotile", benchAutotile, "tiles/s"},
+    {"castRay", benchCastRay, "rays/s"},
+    {"castRayGrid", benchCastRayGrid, "rays/s"},
+    {"castRaySoA", benchCastRaySoA, "rays/s"},
+    {"castRaysBatch", benchCastRaysBatch, "rays/s"},
+    {"calculateSightTriangles/sweep", benchSightSweep, "edges/s"},
+    {"calculateSightTriangles/rayFan", benchSightRayFan, "edges/s"},
+};
+#define BENCHMARK_COUNT ((int)(sizeof(BENCHMARKS) / sizeof(BENCHMARKS[0])))
+
+// Warm up, then time reps batches of ops. Slow functions get fewer reps
+static void measureBenchmark(const Benchmark *benchmark, BenchContext *context, int reps, double batchNs, BenchResult *result)
+{
+    // warmup, which also tells how many ops fit in a batch
+    int op = 0;
+    int ops = 1;
+    double warmupNs = 0;
+    double nsPerOp = 0;
+    while (warmupNs < WARMUP_NS)
+    {
+        uint64_t start = profilerNow();
+        benchmark->run(context, op, ops);
+        double elapsed = (double)(profilerNow() - start);
+        op += ops;
+        warmupNs += elapsed;
+        nsPerOp = elapsed / ops;
+        if (nsPerOp > SLOW_OP_NS)
+            break;
+        if (elapsed < batchNs / 4)
+            ops *= 2;
+    }
+    int opsPerRep = nsPerOp > 0 ? (int)(batchNs / nsPerOp) : 1;
+    if (opsPerRep < 1)
+        opsPerRep = 1;
+    if (nsPerOp > SLOW_OP_NS && reps > SLOW_OP_REPS)
+        reps = SLOW_OP_REPS;
+
+    double times[MAX_REPS];
+    double work = 0;
+    for (int rep = 0; rep < reps; rep++)
+    {
+        uint64_t start = profilerNow();
+        work += benchmark->run(context, op, opsPerRep);
+        times[rep] = (double)(profilerNow() - start) / opsPerRep;
+        op += opsPerRep;
+    }
+
+    double sum = 0;
+    for (int rep = 0; rep < reps; rep++)
+    {
+        sum += times[rep];
+    }
+    double mean = sum / reps;
+    double variance = 0;
+    for (int rep = 0; rep < reps; rep++)
+    {
+        variance += (times[rep] - mean) * (times[rep] - mean);
+    }
+    qsort(times, reps, sizeof(double), compareDoubles);
+    double median = reps % 2 == 1 ? times[reps / 2] : (times[reps / 2 - 1] + times[reps / 2]) / 2;
+
+    snprintf(result->name, sizeof(result->name), "%s", benchmark->name);
+    result->nsPerOp = median;
+    result->minNsPerOp = times[0];
+    result->meanNsPerOp = mean;
+    result->stddevNsPerOp = reps > 1 ? sqrt(variance / (reps - 1)) : 0;
+    result->reps = reps;
+    result->opsPerRep = opsPerRep;
+    double workPerOp = work / ((double)reps * opsPerRep);
+    result->throughput = median > 0 ? workPerOp * 1e9 / median : 0;
+    result->unit = benchmark->unit;
+}
+
+static void printResultRow(BenchResult *result)
+{
+    printf("%-32s %-8s %5d  %14.1f %14.1f %12.1f %5.1f%%  %10.3e %s\n",
+           result->name, result->map, result->size, result->nsPerOp, result->minNsPerOp, result->stddevNsPerOp,
+           result->meanNsPerOp > 0 ? 100.0 * result->stddevNsPerOp / result->meanNsPerOp : 0.0, result->throughput, result->unit);
+}
+
+static void printResultJson(BenchResult *result, bool last)
+{
+    printf("{\"name\":\"%s\",\"map\":\"%s\",\"size\":%d,\"nsPerOp\":%.3f,\"minNsPerOp\":%.3f,\"meanNsPerOp\":%.3f,"
+           "\"stddevNsPerOp\":%.3f,\"reps\":%d,\"opsPerRep\":%d,\"throughput\":%.6e,\"unit\":\"%s\"}%s\n",
+           result->name, result->map, result->size, result->nsPerOp, result->minNsPerOp, result->meanNsPerOp,
+           result->stddevNsPerOp, result->reps, result->opsPerRep, result->throughput, result->unit, last ? "" : ",");
+}
+
+/*
+Read the results of an earlier -json run. Only reads what printResultJson writes, one result per line.
+Returns how many, or -1 if the file can't be opened
+*/
+static int loadBaseline(const char *path, BenchResult *results, int maxResults)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+        return -1;
+    char line[MAX_LINE];
+    int count = 0;
+    while (count < maxResults && fgets(line, sizeof(line), file) != NULL)
+    {
+        BenchResult *result = &results[count];
+        if (sscanf(line, "{\"name\":\"%63[^\"]\",\"map\":\"%15[^\"]\",\"size\":%d,\"nsPerOp\":%lf",
+                   result->name, result->map, &result->size, &result->nsPerOp) == 4)
+            count++;
+    }
+    fclose(file);
+    return count;
+}
+
+/*
+Compare against the baseline. Goes to stderr, so -json output stays clean.
+Returns the number of results more than threshold percent slower
+*/
+static int compareWithBaseline(BenchResult *results, int resultCount, BenchResult *baseline, int baselineCount, double threshold)
+{
+    int regressions = 0;
+    fprintf(stderr, "\n%-32s %-8s %5s  %12s %12s %8s\n", "function", "map", "size", "baseline ns", "ns/op", "change");
+    for (int i = 0; i < resultCount; i++)
+    {
+        BenchResult *result = &results[i];
+        BenchResult *old = NULL;
+        for (int j = 0; j < baselineCount && old == NULL; j++)
+        {
+            if (strcmp(baseline[j].name, result->name) == 0 && strcmp(baseline[j].map, result->map) == 0 && baseline[j].size == result->size)
+                old = &baseline[j];
+        }
+        if (old == NULL || old->nsPerOp <= 0)
+        {
+            fprintf(stderr, "%-32s %-8s %5d  %12s %12.1f %8s\n", result->name, result->map, result->size, "-", result->nsPerOp, "new");
+            continue;
+        }
+        double change = 100.0 * (result->nsPerOp / old->nsPerOp - 1.0);
+        bool regressed = change > threshold;
+        regressions += regressed;
+        fprintf(stderr, "%-32s %-8s %5d  %12.1f %12.1f %+7.1f%%%s\n", result->name, result->map, result->size,
+                old->nsPerOp, result->nsPerOp, change, regressed ? "  REGRESSION" : "");
+    }
+    return regressions;
+}
+
+// Parse a comma separated list of ints. Returns how many
+static int parseSizes(const char *list, int *sizes, int maxSizes)
+{
+    int count = 0;
+    const char *next = list;
+    while (*next != '\0' && count < maxSizes)
+    {
+        char *end;
+        long size = strtol(next, &end, 10);
+        if (end == next)
+            break;
+        if (size >= 8)
+            sizes[count++] = (int)size;
+        next = *end == ',' ? end + 1 : end;
+    }
+    return count;
+}
+
+// Whether name is in a comma separated list, or the list is NULL
+static bool isListed(const char *list, const char *name)
+{
+    if (list == NULL)
+        return true;
+    size_t length = strlen(name);
+    for (const char *found = strstr(list, name); found != NULL; found = strstr(found + 1, name))
+    {
+        bool startsItem = found == list || found[-1] == ',';
+        bool endsItem = found[length] == '\0' || found[length] == ',';
+        if (startsItem && endsItem)
+            return true;
+    }
+    return false;
+}
+
+int main(int argc, char **argv)
+{
+    const char *filter = NULL;
+    const char *maps = NULL;
+    const char *baselinePath = NULL;
+    int sizes[MAX_SIZES] = {16, 64, 256, 1024, 4096};
+    int sizeCount = 5;
+    int reps = DEFAULT_REPS;
+    double batchNs = DEFAULT_BATCH_MS * 1e6;
+    double threshold = DEFAULT_THRESHOLD;
+    bool json = false;
+    RayCastMode rayCastMode = RAYCAST_GRID;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-filter") == 0 && i + 1 < argc)
+            filter = argv[++i];
+        else if (strcmp(argv[i], "-maps") == 0 && i + 1 < argc)
+            maps = argv[++i];
+        else if (strcmp(argv[i], "-sizes") == 0 && i + 1 < argc)
+            sizeCount = parseSizes(argv[++i], sizes, MAX_SIZES);
+        else if (strcmp(argv[i], "-reps") == 0 && i + 1 < argc)
+            reps = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-time") == 0 && i + 1 < argc)
+            batchNs = atof(argv[++i]) * 1e6;
+        else if (strcmp(argv[i], "-json") == 0)
+            json = true;
+        else if (strcmp(argv[i], "-baseline") == 0 && i + 1 < argc)
+            baselinePath = argv[++i];
+        else if (strcmp(argv[i], "-threshold") == 0 && i + 1 < argc)
+            threshold = atof(argv[++i]);
+        else if (strcmp(argv[i], "-raycast") == 0 && i + 1 < argc && parseRayCastMode(argv[i + 1], &rayCastMode))
+            i++;
+        else
+        {
+            fprintf(stderr, "usage: %s [-filter name] [-maps open,maze,noise,pillars] [-sizes 16,64,...] [-reps N] [-time ms] [-json] [-baseline old.json] [-threshold percent] [-raycast grid|brute|simd]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (reps < 1)
+        reps = 1;
+    if (reps > MAX_REPS)
+        reps = MAX_REPS;
+
+    static BenchResult baseline[MAX_RESULTS];
+    int baselineCount = 0;
+    if (baselinePath != NULL)
+    {
+        baselineCount = loadBaseline(baselinePath, baseline, MAX_RESULTS);
+        if (baselineCount < 0)
+        {
+            fprintf(stderr, "can't open baseline %s\n", baselinePath);
+            return 2;
+        }
+    }
+#ifndef __OPTIMIZE__
+    fprintf(stderr, "warning: built without optimization, the numbers mean little. build with BUILD_MODE=RELEASE\n");
+#endif
+
+    GameState game = {0};
+    game.screenWidth = 800;
+    game.screenHeight = 800;
+    game.headless = true;
+    InitGame(&game);
+    game.rayCastMode = rayCastMode;
+    BenchContext context = {0};
+
+    static BenchResult results[MAX_RESULTS];
+    int resultCount = 0;
+    if (json)
+        printf("{\"results\":[\n");
+    else
+        printf("%-32s %-8s %5s  %14s %14s %12s %6s  %s\n", "function", "map", "size", "median ns/op", "min ns/op", "stddev", "", "throughput");
+    for (int map = 0; map < MAP_COUNT; map++)
+    {
+        if (!isListed(maps, MAP_NAMES[map]))
+            continue;
+        for (int s = 0; s < sizeCount; s++)
+        {
+            generateBenchMap(&game, map, sizes[s]);
+            initBenchContext(&context, &game);
+            for (int b = 0; b < BENCHMARK_COUNT && resultCount < MAX_RESULTS; b++)
+            {
+                if (filter != NULL && strstr(BENCHMARKS[b].name, filter) == NULL)
+                    continue;
+                BenchResult *result = &results[resultCount];
+                measureBenchmark(&BENCHMARKS[b], &context, reps, batchNs, result);
+                benchSink = context.checksum;
+                snprintf(result->map, sizeof(result->map), "%s", MAP_NAMES[map]);
+                result->size = sizes[s];
+                // as they come in, the big maps take a while. JSON waits to know which one is last
+                if (!json)
+                {
+                    printResultRow(result);
+                    fflush(stdout);
+                }
+                resultCount++;
+            }
+        }
+    }
+    if (json)
+    {
+        for (int i = 0; i < resultCount; i++)
+        {
+            printResultJson(&results[i], i == resultCount - 1);
+        }
+        printf("]}\n");
+    }
+
+    int regressions = 0;
+    if (baselinePath != NULL)
+    {
+        regressions = compareWithBaseline(results, resultCount, baseline, baselineCount, threshold);
+        fprintf(stderr, "%d of %d slower than the baseline by more than %.1f%%\n", regressions, resultCount, threshold);
+    }
+
+    freeBenchContext(&context);
+    FreeGame(&game);
+    return regressions > 0 ? 1 : 0;
+}
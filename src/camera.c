@@ -8,9 +8,32 @@ void updateCamera(GameState *game)
 {
     // How fast does the camera follow the player
     float camFollowSpeed = 0.02f;
-    // lerp the camera to the player position
+    // lerp the camera to the player position, once per fixed step
     game->playerCamera->camPos.x = Lerp(game->playerCamera->camPos.x, game->player->playerPos.x, camFollowSpeed);
     game->playerCamera->camPos.y = Lerp(game->playerCamera->camPos.y, game->player->playerPos.y, camFollowSpeed);
+    // the lerp never quite gets there. stop once it's close, so a still scene stops changing and isn't redrawn
+    if (Vector2Distance(game->playerCamera->camPos, game->player->playerPos) < 0.1f)
+        game->playerCamera->camPos = game->player->playerPos;
     // set the camera's tartget to the new camPos
     game->playerCamera->camera.target = game->playerCamera->camPos;
+}
+
+// The part of the world on screen. The camera puts target at offset (in screen pixels) and scales by zoom
+Rectangle getCameraViewRect(GameState *game)
+{
+    Camera2D camera = game->playerCamera->camera;
+    Rectangle view;
+    view.x = camera.target.x - camera.offset.x / camera.zoom;
+    view.y = camera.target.y - camera.offset.y / camera.zoom;
+    view.width = game->screenWidth / camera.zoom;
+    view.height = game->screenHeight / camera.zoom;
+    return view;
+}
+
+// The same view, for drawing into a target 1/scale the size of the screen
+Camera2D getScaledCamera(Camera2D camera, int scale)
+{
+    camera.offset = Vector2Scale(camera.offset, 1.0f / scale);
+    camera.zoom /= scale;
+    return camera;
 }
\ No newline at end of file
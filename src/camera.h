@@ -13,4 +13,6 @@ typedef struct PlayerCamera
 
 // Functions
 void updateCamera(GameState *game);
+Rectangle getCameraViewRect(GameState *game);
+Camera2D getScaledCamera(Camera2D camera, int scale);
 #endif
\ No newline at end of file
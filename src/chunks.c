@@ -0,0 +1,476 @@
+#include "raylib.h"
+#include "chunks.h"
+#include "game_state.h"
+#include "world.h"
+#include "camera.h"
+#include "frame_arena.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// the generator places at most one block of wall in every cell of this many tiles
+#define GENERATOR_CELL_SIZE 8
+
+// Division rounding towards -infinity, so tile -1 is in chunk -1
+static int floorDivide(int value, int divisor)
+{
+    int quotient = value / divisor;
+    if (value % divisor != 0 && value < 0)
+        quotient--;
+    return quotient;
+}
+
+// Integer hash (murmur3 finalizer)
+static unsigned int hashInt(unsigned int value)
+{
+    value ^= value >> 16;
+    value *= 0x85ebca6bu;
+    value ^= value >> 13;
+    value *= 0xc2b2ae35u;
+    value ^= value >> 16;
+    return value;
+}
+
+static unsigned int hashChunk(int chunkX, int chunkY)
+{
+    return hashInt((unsigned int)chunkX * 73856093u ^ (unsigned int)chunkY * 19349663u);
+}
+
+/*
+The tile the world starts with at (x, y). Most cells of GENERATOR_CELL_SIZE tiles get a block of wall,
+1 to 4 tiles on each side, with at least one floor tile around it so every floor tile can be reached.
+The cell at the origin stays empty, since the player starts there.
+*/
+static TileType generateTile(unsigned int seed, int x, int y)
+{
+    int cellX = floorDivide(x, GENERATOR_CELL_SIZE);
+    int cellY = floorDivide(y, GENERATOR_CELL_SIZE);
+    unsigned int cellHash = hashInt(seed ^ hashChunk(cellX, cellY));
+    if ((cellX == 0 && cellY == 0) || cellHash % 4 == 0)
+        return TILE_FLOOR;
+
+    int width = 1 + (cellHash >> 2) % 4;
+    int height = 1 + (cellHash >> 4) % 4;
+    int left = 1 + (cellHash >> 6) % (GENERATOR_CELL_SIZE - 1 - width);
+    int top = 1 + (cellHash >> 9) % (GENERATOR_CELL_SIZE - 1 - height);
+    int localX = x - cellX * GENERATOR_CELL_SIZE;
+    int localY = y - cellY * GENERATOR_CELL_SIZE;
+    if (localX >= left && localX < left + width && localY >= top && localY < top + height)
+        return TILE_WALL;
+    return TILE_FLOOR;
+}
+
+// Slot holding the chunk, or the empty slot where it would go
+static int findSlot(ChunkWorld *world, int chunkX, int chunkY)
+{
+    unsigned int mask = world->slotCount - 1;
+    unsigned int slot = hashChunk(chunkX, chunkY) & mask;
+    while (world->slots[slot] != NULL && (world->slots[slot]->chunkX != chunkX || world->slots[slot]->chunkY != chunkY))
+        slot = (slot + 1) & mask;
+    return slot;
+}
+
+static Chunk *findChunk(ChunkWorld *world, int chunkX, int chunkY)
+{
+    return world->slots[findSlot(world, chunkX, chunkY)];
+}
+
+// Double the hash map, keeping it at most half full
+static void growSlots(ChunkWorld *world)
+{
+    Chunk **oldSlots = world->slots;
+    int oldSlotCount = world->slotCount;
+    world->slotCount *= 2;
+    world->slots = calloc(world->slotCount, sizeof(Chunk *));
+    for (int i = 0; i < oldSlotCount; i++)
+    {
+        if (oldSlots[i] != NULL)
+            world->slots[findSlot(world, oldSlots[i]->chunkX, oldSlots[i]->chunkY)] = oldSlots[i];
+    }
+    free(oldSlots);
+}
+
+// bytes of an RGBA tile layer for one chunk
+#define CHUNK_TILE_LAYER_BYTES ((size_t)CHUNK_SIZE * TILE_LAYER_PIXELS * CHUNK_SIZE * TILE_LAYER_PIXELS * 4)
+
+static size_t chunkMemory(Chunk *chunk)
+{
+    return sizeof(Chunk) + chunk->edgeCapacity * sizeof(Edge) + (chunk->tileLayer.id != 0 ? CHUNK_TILE_LAYER_BYTES : 0);
+}
+
+// Type of a tile next to (or inside) a chunk, looking in the chunk itself when possible
+static TileType getTileNearChunk(ChunkWorld *world, Chunk *chunk, int localX, int localY)
+{
+    if (localX >= 0 && localX < CHUNK_SIZE && localY >= 0 && localY < CHUNK_SIZE)
+        return chunk->tiles[localY * CHUNK_SIZE + localX];
+    return chunkWorldGetTile(world, chunk->chunkX * CHUNK_SIZE + localX, chunk->chunkY * CHUNK_SIZE + localY);
+}
+
+// Bit for every neighbour of the same type as the tile, like computeTileNeighborMask in world.c
+static unsigned char computeChunkNeighborMask(ChunkWorld *world, Chunk *chunk, int localX, int localY)
+{
+    TileType tileType = chunk->tiles[localY * CHUNK_SIZE + localX];
+    unsigned char neighborMask = 0;
+    for (int i = 0; i < 8; i++)
+    {
+        if (getTileNearChunk(world, chunk, localX + NEIGHBOR_OFFSETS[i][0], localY + NEIGHBOR_OFFSETS[i][1]) == tileType)
+            neighborMask |= 1 << i;
+    }
+    return neighborMask;
+}
+
+// Get a chunk, generating it if it isn't loaded. Marks it as used this frame
+static Chunk *loadChunk(ChunkWorld *world, int chunkX, int chunkY)
+{
+    Chunk *chunk = findChunk(world, chunkX, chunkY);
+    if (chunk == NULL)
+    {
+        if ((world->chunkCount + 1) * 2 > world->slotCount)
+            growSlots(world);
+
+        chunk = calloc(1, sizeof(Chunk));
+        chunk->chunkX = chunkX;
+        chunk->chunkY = chunkY;
+        for (int y = 0; y < CHUNK_SIZE; y++)
+        {
+            for (int x = 0; x < CHUNK_SIZE; x++)
+            {
+                chunk->tiles[y * CHUNK_SIZE + x] = generateTile(world->seed, chunkX * CHUNK_SIZE + x, chunkY * CHUNK_SIZE + y);
+            }
+        }
+        for (int y = 0; y < CHUNK_SIZE; y++)
+        {
+            for (int x = 0; x < CHUNK_SIZE; x++)
+            {
+                chunk->neighborMasks[y * CHUNK_SIZE + x] = computeChunkNeighborMask(world, chunk, x, y);
+            }
+        }
+        chunk->edgesDirty = true;
+        world->slots[findSlot(world, chunkX, chunkY)] = chunk;
+        world->chunkCount++;
+        world->memoryUsed += chunkMemory(chunk);
+    }
+    chunk->lastUsedFrame = world->frame;
+    return chunk;
+}
+
+// Free the chunk in a slot. Later chunks of its probe chain are shifted back, so lookups never need tombstones
+static void unloadChunk(ChunkWorld *world, int slot)
+{
+    Chunk *chunk = world->slots[slot];
+    world->memoryUsed -= chunkMemory(chunk);
+    if (chunk->tileLayer.id != 0)
+    {
+        world->releasedTileLayers = growBuffer(NULL, world->releasedTileLayers, &world->releasedTileLayerCapacity,
+                                               world->releasedTileLayerCount + 1, sizeof(RenderTexture2D));
+        world->releasedTileLayers[world->releasedTileLayerCount] = chunk->tileLayer;
+        world->releasedTileLayerCount++;
+    }
+    free(chunk->edges);
+    free(chunk);
+    world->slots[slot] = NULL;
+    world->chunkCount--;
+
+    unsigned int mask = world->slotCount - 1;
+    unsigned int hole = slot;
+    for (unsigned int i = (slot + 1) & mask; world->slots[i] != NULL; i = (i + 1) & mask)
+    {
+        unsigned int home = hashChunk(world->slots[i]->chunkX, world->slots[i]->chunkY) & mask;
+        // the chunk can fill the hole if the hole is between its home slot and its current slot
+        if (((i - home) & mask) >= ((i - hole) & mask))
+        {
+            world->slots[hole] = world->slots[i];
+            world->slots[i] = NULL;
+            hole = i;
+        }
+    }
+}
+
+// Evict the least recently used chunks until the world fits its budget. Chunks used this frame and edited chunks stay
+static void evictChunks(ChunkWorld *world)
+{
+    while (world->memoryUsed > world->memoryBudget)
+    {
+        int oldest = -1;
+        for (int i = 0; i < world->slotCount; i++)
+        {
+            Chunk *chunk = world->slots[i];
+            if (chunk == NULL || chunk->modified || chunk->lastUsedFrame == world->frame)
+                continue;
+            if (oldest == -1 || chunk->lastUsedFrame < world->slots[oldest]->lastUsedFrame)
+                oldest = i;
+        }
+        if (oldest == -1)
+            break;
+        unloadChunk(world, oldest);
+    }
+}
+
+void initChunkWorld(ChunkWorld *world, unsigned int seed, size_t memoryBudget)
+{
+    *world = (ChunkWorld){0};
+    world->seed = seed;
+    world->memoryBudget = memoryBudget;
+    world->slotCount = 64;
+    world->slots = calloc(world->slotCount, sizeof(Chunk *));
+}
+
+void freeChunkWorld(ChunkWorld *world)
+{
+    for (int i = 0; i < world->slotCount; i++)
+    {
+        if (world->slots[i] != NULL)
+        {
+            if (world->slots[i]->tileLayer.id != 0)
+                UnloadRenderTexture(world->slots[i]->tileLayer);
+            free(world->slots[i]->edges);
+            free(world->slots[i]);
+        }
+    }
+    unloadReleasedTileLayers(world);
+    free(world->releasedTileLayers);
+    free(world->slots);
+    *world = (ChunkWorld){0};
+}
+
+// Type of any tile in the world. Chunks that aren't loaded were never edited, so they are generated on the fly instead
+TileType chunkWorldGetTile(ChunkWorld *world, int x, int y)
+{
+    int chunkX = floorDivide(x, CHUNK_SIZE);
+    int chunkY = floorDivide(y, CHUNK_SIZE);
+    Chunk *chunk = findChunk(world, chunkX, chunkY);
+    if (chunk == NULL)
+        return generateTile(world->seed, x, y);
+    return chunk->tiles[(y - chunkY * CHUNK_SIZE) * CHUNK_SIZE + x - chunkX * CHUNK_SIZE];
+}
+
+// Does the tile have an exposed face on this side? An opaque tile next to a see-through one, same rule as roomTilesToRoomLines
+static bool chunkTileHasFace(ChunkWorld *world, Chunk *chunk, int localX, int localY, Direction side)
+{
+    if (!IsTileTypeOpaque(chunk->tiles[localY * CHUNK_SIZE + localX]))
+        return false;
+    int neighborX = localX + (side == DIRECTION_EAST) - (side == DIRECTION_WEST);
+    int neighborY = localY + (side == DIRECTION_SOUTH) - (side == DIRECTION_NORTH);
+    return !IsTileTypeOpaque(getTileNearChunk(world, chunk, neighborX, neighborY));
+}
+
+/*
+Build the edges of a chunk. Faces next to each other on the same side are merged into one edge,
+with the same corners roomTilesToRoomLines uses, but edges never cross into the next chunk.
+*/
+static void buildChunkEdges(ChunkWorld *world, Chunk *chunk, int tileSize)
+{
+    world->memoryUsed -= chunkMemory(chunk);
+    chunk->edgeCount = 0;
+    for (int side = DIRECTION_NORTH; side <= DIRECTION_WEST; side++)
+    {
+        bool alongRow = side == DIRECTION_NORTH || side == DIRECTION_SOUTH;
+        for (int line = 0; line < CHUNK_SIZE; line++)
+        {
+            for (int p = 0; p < CHUNK_SIZE; p++)
+            {
+                int localX = alongRow ? p : line;
+                int localY = alongRow ? line : p;
+                if (!chunkTileHasFace(world, chunk, localX, localY, side))
+                    continue;
+
+                int runEnd = p;
+                while (runEnd + 1 < CHUNK_SIZE &&
+                       chunkTileHasFace(world, chunk, alongRow ? runEnd + 1 : line, alongRow ? line : runEnd + 1, side))
+                    runEnd++;
+
+                chunk->edges = growBuffer(NULL, chunk->edges, &chunk->edgeCapacity, chunk->edgeCount + 1, sizeof(Edge));
+                Edge *edge = &chunk->edges[chunk->edgeCount];
+                chunk->edgeCount++;
+                float startX = (chunk->chunkX * CHUNK_SIZE + localX) * (float)tileSize + (side == DIRECTION_EAST ? tileSize : 0);
+                float startY = (chunk->chunkY * CHUNK_SIZE + localY) * (float)tileSize + (side == DIRECTION_SOUTH ? tileSize : 0);
+                float length = (runEnd - p + 1) * (float)tileSize;
+                edge->visited = true;
+                edge->start = (Vector2){startX, startY};
+                edge->end = alongRow ? (Vector2){startX + length, startY} : (Vector2){startX, startY + length};
+                p = runEnd;
+            }
+        }
+    }
+    chunk->edgesDirty = false;
+    world->memoryUsed += chunkMemory(chunk);
+}
+
+/*
+Change one tile of the world. The chunk is kept loaded from now on, and its edges (and the edges of
+a neighbouring chunk, for tiles on the border) are rebuilt the next time they are gathered
+*/
+void chunkWorldSetTile(GameState *game, int x, int y, TileType type)
+{
+    ChunkWorld *world = game->chunkWorld;
+    int chunkX = floorDivide(x, CHUNK_SIZE);
+    int chunkY = floorDivide(y, CHUNK_SIZE);
+    Chunk *chunk = loadChunk(world, chunkX, chunkY);
+    int localX = x - chunkX * CHUNK_SIZE;
+    int localY = y - chunkY * CHUNK_SIZE;
+    if (chunk->tiles[localY * CHUNK_SIZE + localX] == type)
+        return;
+    chunk->tiles[localY * CHUNK_SIZE + localX] = type;
+    chunk->modified = true;
+    chunk->edgesDirty = true;
+
+    // neighbouring chunks that aren't loaded will see the new tile when they are built
+    int neighbors[4][2] = {{localX == 0 ? -1 : 0, 0}, {localX == CHUNK_SIZE - 1 ? 1 : 0, 0}, {0, localY == 0 ? -1 : 0}, {0, localY == CHUNK_SIZE - 1 ? 1 : 0}};
+    for (int i = 0; i < 4; i++)
+    {
+        if (neighbors[i][0] == 0 && neighbors[i][1] == 0)
+            continue;
+        Chunk *neighbor = findChunk(world, chunkX + neighbors[i][0], chunkY + neighbors[i][1]);
+        if (neighbor != NULL)
+            neighbor->edgesDirty = true;
+    }
+    // masks of the 3x3 tiles around it, in whichever loaded chunks they are. they all need to be drawn again
+    for (int neighborY = y - 1; neighborY <= y + 1; neighborY++)
+    {
+        for (int neighborX = x - 1; neighborX <= x + 1; neighborX++)
+        {
+            int neighborChunkX = floorDivide(neighborX, CHUNK_SIZE);
+            int neighborChunkY = floorDivide(neighborY, CHUNK_SIZE);
+            Chunk *neighborChunk = findChunk(world, neighborChunkX, neighborChunkY);
+            if (neighborChunk == NULL)
+                continue;
+            int neighborLocalX = neighborX - neighborChunkX * CHUNK_SIZE;
+            int neighborLocalY = neighborY - neighborChunkY * CHUNK_SIZE;
+            neighborChunk->neighborMasks[neighborLocalY * CHUNK_SIZE + neighborLocalX] = computeChunkNeighborMask(world, neighborChunk, neighborLocalX, neighborLocalY);
+            growTileRegion(&neighborChunk->tileLayerDirty, neighborLocalX, neighborLocalY);
+        }
+    }
+    // cached visibility near this tile is stale
+    game->roomEdgeVersion++;
+}
+
+/*
+Collect the edges of every chunk within maxDistance of origin into one buffer, loading chunks and
+building their edges as needed. Returns the number of edges. Main thread only, chunks can be loaded
+*/
+int gatherChunkEdges(GameState *game, Vector2 origin, float maxDistance, Edge **edges, int *edgeCapacity)
+{
+    ChunkWorld *world = game->chunkWorld;
+    float chunkPixels = (float)CHUNK_SIZE * game->tileSize;
+    int minChunkX = (int)floorf((origin.x - maxDistance) / chunkPixels);
+    int maxChunkX = (int)floorf((origin.x + maxDistance) / chunkPixels);
+    int minChunkY = (int)floorf((origin.y - maxDistance) / chunkPixels);
+    int maxChunkY = (int)floorf((origin.y + maxDistance) / chunkPixels);
+
+    int edgeCount = 0;
+    for (int chunkY = minChunkY; chunkY <= maxChunkY; chunkY++)
+    {
+        for (int chunkX = minChunkX; chunkX <= maxChunkX; chunkX++)
+        {
+            // skip the corners of the square that are out of range
+            float dx = fmaxf(fmaxf(chunkX * chunkPixels - origin.x, origin.x - (chunkX + 1) * chunkPixels), 0);
+            float dy = fmaxf(fmaxf(chunkY * chunkPixels - origin.y, origin.y - (chunkY + 1) * chunkPixels), 0);
+            if (dx * dx + dy * dy > maxDistance * maxDistance)
+                continue;
+
+            Chunk *chunk = loadChunk(world, chunkX, chunkY);
+            if (chunk->edgesDirty)
+                buildChunkEdges(world, chunk, game->tileSize);
+            if (chunk->edgeCount == 0)
+                continue;
+            *edges = growBuffer(game->frameArena, *edges, edgeCapacity, edgeCount + chunk->edgeCount, sizeof(Edge));
+            memcpy(*edges + edgeCount, chunk->edges, chunk->edgeCount * sizeof(Edge));
+            edgeCount += chunk->edgeCount;
+        }
+    }
+    return edgeCount;
+}
+
+// Range of chunks the camera can see, with a margin of chunks so they are loaded before they scroll in
+static void getVisibleChunks(GameState *game, int margin, int *minChunkX, int *minChunkY, int *maxChunkX, int *maxChunkY)
+{
+    Rectangle view = getCameraViewRect(game);
+    float chunkPixels = (float)CHUNK_SIZE * game->tileSize;
+    *minChunkX = (int)floorf(view.x / chunkPixels) - margin;
+    *minChunkY = (int)floorf(view.y / chunkPixels) - margin;
+    *maxChunkX = (int)floorf((view.x + view.width) / chunkPixels) + margin;
+    *maxChunkY = (int)floorf((view.y + view.height) / chunkPixels) + margin;
+}
+
+// Load the chunks around the camera and evict the ones that haven't been used for the longest
+void updateChunkWorld(GameState *game)
+{
+    ChunkWorld *world = game->chunkWorld;
+    world->frame++;
+
+    int minChunkX, minChunkY, maxChunkX, maxChunkY;
+    getVisibleChunks(game, 1, &minChunkX, &minChunkY, &maxChunkX, &maxChunkY);
+    for (int chunkY = minChunkY; chunkY <= maxChunkY; chunkY++)
+    {
+        for (int chunkX = minChunkX; chunkX <= maxChunkX; chunkX++)
+        {
+            loadChunk(world, chunkX, chunkY);
+        }
+    }
+    evictChunks(world);
+}
+
+static void getChunkTile(void *source, int x, int y, int *tileType, unsigned char *neighborMask)
+{
+    Chunk *chunk = (Chunk *)source;
+    *tileType = chunk->tiles[y * CHUNK_SIZE + x];
+    *neighborMask = chunk->neighborMasks[y * CHUNK_SIZE + x];
+}
+
+// Unload the tile layers of chunks evicted since last time. Needs the GPU context, so only call it from the render thread
+void unloadReleasedTileLayers(ChunkWorld *world)
+{
+    for (int i = 0; i < world->releasedTileLayerCount; i++)
+    {
+        UnloadRenderTexture(world->releasedTileLayers[i]);
+    }
+    world->releasedTileLayerCount = 0;
+}
+
+/*
+Bring the tile layers of the chunks on screen up to date, making them for chunks that just came into view
+and redrawing only the tiles changed since the last bake. Has to be called outside of any other texture mode
+*/
+void bakeChunkTileLayers(GameState *game)
+{
+    ChunkWorld *world = game->chunkWorld;
+    unloadReleasedTileLayers(world);
+    int minChunkX, minChunkY, maxChunkX, maxChunkY;
+    getVisibleChunks(game, 0, &minChunkX, &minChunkY, &maxChunkX, &maxChunkY);
+    for (int chunkY = minChunkY; chunkY <= maxChunkY; chunkY++)
+    {
+        for (int chunkX = minChunkX; chunkX <= maxChunkX; chunkX++)
+        {
+            Chunk *chunk = loadChunk(world, chunkX, chunkY);
+            if (chunk->tileLayer.id == 0)
+            {
+                chunk->tileLayer = LoadRenderTexture(CHUNK_SIZE * TILE_LAYER_PIXELS, CHUNK_SIZE * TILE_LAYER_PIXELS);
+                chunk->tileLayerDirty = (TileRegion){0, 0, CHUNK_SIZE - 1, CHUNK_SIZE - 1};
+                world->memoryUsed += CHUNK_TILE_LAYER_BYTES;
+            }
+            if (isTileRegionEmpty(chunk->tileLayerDirty))
+                continue;
+            bakeTileLayer(game, chunk->tileLayer, chunk->tileLayerDirty, getChunkTile, chunk);
+            chunk->tileLayerDirty = EMPTY_TILE_REGION;
+        }
+    }
+}
+
+// Draw the chunks on screen from their baked tile layers, see bakeChunkTileLayers
+void drawChunkWorld(GameState *game)
+{
+    ChunkWorld *world = game->chunkWorld;
+    float chunkPixels = (float)CHUNK_SIZE * game->tileSize;
+    int minChunkX, minChunkY, maxChunkX, maxChunkY;
+    getVisibleChunks(game, 0, &minChunkX, &minChunkY, &maxChunkX, &maxChunkY);
+    for (int chunkY = minChunkY; chunkY <= maxChunkY; chunkY++)
+    {
+        for (int chunkX = minChunkX; chunkX <= maxChunkX; chunkX++)
+        {
+            Chunk *chunk = findChunk(world, chunkX, chunkY);
+            if (chunk == NULL || chunk->tileLayer.id == 0)
+                continue;
+            drawTileLayer(chunk->tileLayer, (Rectangle){chunkX * chunkPixels, chunkY * chunkPixels, chunkPixels, chunkPixels});
+        }
+    }
+}
@@ -0,0 +1,62 @@
+#ifndef CHUNKS_H_
+#define CHUNKS_H_
+
+#include "raylib.h"
+#include "game_state.h"
+#include <stddef.h>
+
+// tiles along each side of a chunk
+#define CHUNK_SIZE 32
+// default memory budget for loaded chunks (tiles, edges and tile layers), before the least recently used are evicted
+#define CHUNK_MEMORY_BUDGET (16 * 1024 * 1024)
+
+// Structs
+
+// CHUNK_SIZE x CHUNK_SIZE tiles of the streamed world, with the edges of its walls
+typedef struct Chunk
+{
+    int chunkX; // chunk coordinates, tile coordinates / CHUNK_SIZE
+    int chunkY;
+    unsigned char tiles[CHUNK_SIZE * CHUNK_SIZE]; // TileType of each tile, row major
+    unsigned char neighborMasks[CHUNK_SIZE * CHUNK_SIZE]; // NEIGHBOR_ bits of each tile, see world.h
+    Edge *edges;   // wall faces in this chunk, in world pixels. runs stop at the chunk border
+    int edgeCount;
+    int edgeCapacity;
+    bool edgesDirty;            // tiles changed since the edges were built
+    RenderTexture2D tileLayer;  // the chunk's tiles drawn once, made when the chunk is first on screen
+    TileRegion tileLayerDirty;  // tiles (in chunk coordinates) changed since tileLayer was drawn
+    bool modified;              // edited by the player. kept loaded, since it can't be generated again
+    unsigned int lastUsedFrame; // for LRU eviction
+} Chunk;
+
+/*
+An unbounded world, split into chunks kept in a hash map keyed by chunk coordinates.
+Chunks are generated on demand from the seed, so one that was evicted comes back exactly the same.
+*/
+typedef struct ChunkWorld
+{
+    Chunk **slots;      // open addressing hash map, NULL for empty slots
+    int slotCount;      // power of 2
+    int chunkCount;     // loaded chunks
+    size_t memoryUsed;  // bytes held by loaded chunks
+    size_t memoryBudget;
+    unsigned int frame; // bumped by updateChunkWorld
+    unsigned int seed;
+    // tile layers of evicted chunks. eviction can run off the render thread, so they're unloaded by bakeChunkTileLayers
+    RenderTexture2D *releasedTileLayers;
+    int releasedTileLayerCount;
+    int releasedTileLayerCapacity;
+} ChunkWorld;
+
+// Functions
+void initChunkWorld(ChunkWorld *world, unsigned int seed, size_t memoryBudget);
+void freeChunkWorld(ChunkWorld *world);
+void updateChunkWorld(GameState *game);
+TileType chunkWorldGetTile(ChunkWorld *world, int x, int y);
+void chunkWorldSetTile(GameState *game, int x, int y, TileType type);
+int gatherChunkEdges(GameState *game, Vector2 origin, float maxDistance, Edge **edges, int *edgeCapacity);
+void unloadReleasedTileLayers(ChunkWorld *world);
+void bakeChunkTileLayers(GameState *game);
+void drawChunkWorld(GameState *game);
+
+#endif
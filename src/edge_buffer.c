@@ -0,0 +1,343 @@
+#include "raylib.h"
+#include "edge_buffer.h"
+#include "world.h"
+#include "frame_arena.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+// SSE/AVX2 kernels are only built for x86 with gcc/clang. Everything else uses the scalar kernel
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define EDGE_BUFFER_X86
+#include <immintrin.h>
+#endif
+
+#define EDGE_BUFFER_ALIGN 32
+#define EDGE_BUFFER_WIDTH 8
+// same threshold castRay uses to treat a ray and an edge as parallel
+#define PARALLEL_EPSILON 0.0001f
+
+/*
+Make room for at least paddedCount edges. Grows geometrically and keeps the edges already in the buffer
+*/
+static void reserveEdgeBuffer(EdgeBuffer *buffer, int paddedCount)
+{
+    if (paddedCount <= buffer->capacity && buffer->memory != NULL)
+        return;
+
+    // grow geometrically so repeated rebuilds while editing don't reallocate every time
+    int capacity = buffer->capacity * 2;
+    if (capacity < paddedCount)
+        capacity = paddedCount;
+    if (capacity < EDGE_BUFFER_WIDTH)
+        capacity = EDGE_BUFFER_WIDTH;
+    void *memory = malloc(4 * capacity * sizeof(float) + EDGE_BUFFER_ALIGN);
+    // align the first array, the rest follow at multiples of 8 floats
+    float *aligned = (float *)(((uintptr_t)memory + EDGE_BUFFER_ALIGN - 1) & ~(uintptr_t)(EDGE_BUFFER_ALIGN - 1));
+    if (buffer->memory != NULL)
+    {
+        memcpy(aligned, buffer->startX, buffer->paddedCount * sizeof(float));
+        memcpy(aligned + capacity, buffer->startY, buffer->paddedCount * sizeof(float));
+        memcpy(aligned + 2 * capacity, buffer->dirX, buffer->paddedCount * sizeof(float));
+        memcpy(aligned + 3 * capacity, buffer->dirY, buffer->paddedCount * sizeof(float));
+        free(buffer->memory);
+    }
+    buffer->memory = memory;
+    buffer->capacity = capacity;
+    buffer->startX = aligned;
+    buffer->startY = aligned + capacity;
+    buffer->dirX = aligned + 2 * capacity;
+    buffer->dirY = aligned + 3 * capacity;
+}
+
+// Fill slots [from, to) with empty edges. They have no length, so every ray treats them as parallel
+static void clearEdgeBufferSlots(EdgeBuffer *buffer, int from, int to)
+{
+    for (int i = from; i < to; i++)
+    {
+        buffer->startX[i] = 0;
+        buffer->startY[i] = 0;
+        buffer->dirX[i] = 0;
+        buffer->dirY[i] = 0;
+    }
+}
+
+/*
+Copy edges into the buffer's SoA arrays. Reuses the buffer's memory when it is big enough
+*/
+void buildEdgeBuffer(EdgeBuffer *buffer, Edge *edges, int edgeCount)
+{
+    int paddedCount = (edgeCount + EDGE_BUFFER_WIDTH - 1) / EDGE_BUFFER_WIDTH * EDGE_BUFFER_WIDTH;
+    buffer->paddedCount = 0; // everything is rewritten, nothing to keep if it has to grow
+    reserveEdgeBuffer(buffer, paddedCount);
+
+    for (int i = 0; i < edgeCount; i++)
+    {
+        buffer->startX[i] = edges[i].start.x;
+        buffer->startY[i] = edges[i].start.y;
+        buffer->dirX[i] = edges[i].end.x - edges[i].start.x;
+        buffer->dirY[i] = edges[i].end.y - edges[i].start.y;
+    }
+    clearEdgeBufferSlots(buffer, edgeCount, paddedCount);
+    buffer->count = edgeCount;
+    buffer->paddedCount = paddedCount;
+}
+
+/*
+Same as buildEdgeBuffer, in memory from the arena, for edges only needed this frame (a list gathered in range).
+The buffer doesn't own the memory: don't free it, or set edges on it past edgeCount
+*/
+void buildEdgeBufferInArena(EdgeBuffer *buffer, Edge *edges, int edgeCount, FrameArena *arena)
+{
+    int paddedCount = (edgeCount + EDGE_BUFFER_WIDTH - 1) / EDGE_BUFFER_WIDTH * EDGE_BUFFER_WIDTH;
+    if (paddedCount < EDGE_BUFFER_WIDTH)
+        paddedCount = EDGE_BUFFER_WIDTH;
+    unsigned char *memory = arenaAlloc(arena, 4 * paddedCount * sizeof(float) + EDGE_BUFFER_ALIGN);
+    float *aligned = (float *)(((uintptr_t)memory + EDGE_BUFFER_ALIGN - 1) & ~(uintptr_t)(EDGE_BUFFER_ALIGN - 1));
+    *buffer = (EdgeBuffer){
+        .startX = aligned,
+        .startY = aligned + paddedCount,
+        .dirX = aligned + 2 * paddedCount,
+        .dirY = aligned + 3 * paddedCount,
+        .capacity = paddedCount,
+    };
+    for (int i = 0; i < edgeCount; i++)
+    {
+        buffer->startX[i] = edges[i].start.x;
+        buffer->startY[i] = edges[i].start.y;
+        buffer->dirX[i] = edges[i].end.x - edges[i].start.x;
+        buffer->dirY[i] = edges[i].end.y - edges[i].start.y;
+    }
+    clearEdgeBufferSlots(buffer, edgeCount, paddedCount);
+    buffer->count = edgeCount;
+    buffer->paddedCount = paddedCount;
+}
+
+/*
+Overwrite a single edge, for incremental edits. Indices past the end grow the buffer
+*/
+void setEdgeBufferEdge(EdgeBuffer *buffer, int index, Edge *edge)
+{
+    if (index >= buffer->count)
+    {
+        int count = index + 1;
+        int paddedCount = (count + EDGE_BUFFER_WIDTH - 1) / EDGE_BUFFER_WIDTH * EDGE_BUFFER_WIDTH;
+        reserveEdgeBuffer(buffer, paddedCount);
+        clearEdgeBufferSlots(buffer, buffer->paddedCount, paddedCount);
+        buffer->count = count;
+        if (paddedCount > buffer->paddedCount)
+            buffer->paddedCount = paddedCount;
+    }
+    buffer->startX[index] = edge->start.x;
+    buffer->startY[index] = edge->start.y;
+    buffer->dirX[index] = edge->end.x - edge->start.x;
+    buffer->dirY[index] = edge->end.y - edge->start.y;
+}
+
+void freeEdgeBuffer(EdgeBuffer *buffer)
+{
+    free(buffer->memory);
+    *buffer = (EdgeBuffer){0};
+}
+
+/*
+Kernels: for every ray, find the smallest t > 0 where it crosses an edge (0 <= u <= 1), starting from maxDistance.
+Same math as castRay, written without branches: invalid hits are replaced with maxDistance before the min.
+*/
+typedef void (*RayKernel)(EdgeBuffer *buffer, Vector2 origin, const Vector2 *directions, int rayCount, float maxDistance, float *distances);
+
+static void castRaysScalar(EdgeBuffer *buffer, Vector2 origin, const Vector2 *directions, int rayCount, float maxDistance, float *distances)
+{
+    for (int r = 0; r < rayCount; r++)
+    {
+        float rayX = directions[r].x;
+        float rayY = directions[r].y;
+        float closest = maxDistance;
+        for (int i = 0; i < buffer->count; i++)
+        {
+            float toStartX = buffer->startX[i] - origin.x;
+            float toStartY = buffer->startY[i] - origin.y;
+            float denominator = rayX * buffer->dirY[i] - rayY * buffer->dirX[i];
+            float t = (toStartX * buffer->dirY[i] - toStartY * buffer->dirX[i]) / denominator;
+            float u = (toStartX * rayY - toStartY * rayX) / denominator;
+            bool hit = fabsf(denominator) >= PARALLEL_EPSILON && t > 0 && u >= 0 && u <= 1;
+            closest = (hit && t < closest) ? t : closest;
+        }
+        distances[r] = closest;
+    }
+}
+
+#ifdef EDGE_BUFFER_X86
+// rays are processed in groups, so every block of edges is loaded once per group instead of once per ray
+#define RAY_GROUP 4
+
+__attribute__((target("sse2"))) static void castRaysSSE(EdgeBuffer *buffer, Vector2 origin, const Vector2 *directions, int rayCount, float maxDistance, float *distances)
+{
+    const __m128 originX = _mm_set1_ps(origin.x);
+    const __m128 originY = _mm_set1_ps(origin.y);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 epsilon = _mm_set1_ps(PARALLEL_EPSILON);
+    const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+
+    for (int r = 0; r < rayCount; r += RAY_GROUP)
+    {
+        int groupSize = rayCount - r < RAY_GROUP ? rayCount - r : RAY_GROUP;
+        __m128 rayX[RAY_GROUP], rayY[RAY_GROUP], closest[RAY_GROUP];
+        for (int k = 0; k < RAY_GROUP; k++)
+        {
+            Vector2 direction = directions[r + (k < groupSize ? k : 0)];
+            rayX[k] = _mm_set1_ps(direction.x);
+            rayY[k] = _mm_set1_ps(direction.y);
+            closest[k] = _mm_set1_ps(maxDistance);
+        }
+
+        for (int i = 0; i < buffer->paddedCount; i += 4)
+        {
+            __m128 dirX = _mm_load_ps(&buffer->dirX[i]);
+            __m128 dirY = _mm_load_ps(&buffer->dirY[i]);
+            __m128 toStartX = _mm_sub_ps(_mm_load_ps(&buffer->startX[i]), originX);
+            __m128 toStartY = _mm_sub_ps(_mm_load_ps(&buffer->startY[i]), originY);
+            // numerator of t only depends on the origin, shared by every ray in the group
+            __m128 tNumerator = _mm_sub_ps(_mm_mul_ps(toStartX, dirY), _mm_mul_ps(toStartY, dirX));
+
+            for (int k = 0; k < RAY_GROUP; k++)
+            {
+                __m128 denominator = _mm_sub_ps(_mm_mul_ps(rayX[k], dirY), _mm_mul_ps(rayY[k], dirX));
+                __m128 t = _mm_div_ps(tNumerator, denominator);
+                __m128 u = _mm_div_ps(_mm_sub_ps(_mm_mul_ps(toStartX, rayY[k]), _mm_mul_ps(toStartY, rayX[k])), denominator);
+                __m128 hit = _mm_cmpge_ps(_mm_and_ps(denominator, absMask), epsilon);
+                hit = _mm_and_ps(hit, _mm_cmpgt_ps(t, zero));
+                hit = _mm_and_ps(hit, _mm_cmpge_ps(u, zero));
+                hit = _mm_and_ps(hit, _mm_cmple_ps(u, one));
+                hit = _mm_and_ps(hit, _mm_cmplt_ps(t, closest[k]));
+                closest[k] = _mm_or_ps(_mm_and_ps(hit, t), _mm_andnot_ps(hit, closest[k]));
+            }
+        }
+
+        for (int k = 0; k < groupSize; k++)
+        {
+            // horizontal min of the 4 lanes
+            __m128 m = _mm_min_ps(closest[k], _mm_shuffle_ps(closest[k], closest[k], _MM_SHUFFLE(2, 3, 0, 1)));
+            m = _mm_min_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 0, 3, 2)));
+            distances[r + k] = _mm_cvtss_f32(m);
+        }
+    }
+}
+
+__attribute__((target("avx2"))) static void castRaysAVX2(EdgeBuffer *buffer, Vector2 origin, const Vector2 *directions, int rayCount, float maxDistance, float *distances)
+{
+    const __m256 originX = _mm256_set1_ps(origin.x);
+    const __m256 originY = _mm256_set1_ps(origin.y);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 epsilon = _mm256_set1_ps(PARALLEL_EPSILON);
+    const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+
+    for (int r = 0; r < rayCount; r += RAY_GROUP)
+    {
+        int groupSize = rayCount - r < RAY_GROUP ? rayCount - r : RAY_GROUP;
+        __m256 rayX[RAY_GROUP], rayY[RAY_GROUP], closest[RAY_GROUP];
+        for (int k = 0; k < RAY_GROUP; k++)
+        {
+            Vector2 direction = directions[r + (k < groupSize ? k : 0)];
+            rayX[k] = _mm256_set1_ps(direction.x);
+            rayY[k] = _mm256_set1_ps(direction.y);
+            closest[k] = _mm256_set1_ps(maxDistance);
+        }
+
+        for (int i = 0; i < buffer->paddedCount; i += 8)
+        {
+            __m256 dirX = _mm256_load_ps(&buffer->dirX[i]);
+            __m256 dirY = _mm256_load_ps(&buffer->dirY[i]);
+            __m256 toStartX = _mm256_sub_ps(_mm256_load_ps(&buffer->startX[i]), originX);
+            __m256 toStartY = _mm256_sub_ps(_mm256_load_ps(&buffer->startY[i]), originY);
+            __m256 tNumerator = _mm256_sub_ps(_mm256_mul_ps(toStartX, dirY), _mm256_mul_ps(toStartY, dirX));
+
+            for (int k = 0; k < RAY_GROUP; k++)
+            {
+                __m256 denominator = _mm256_sub_ps(_mm256_mul_ps(rayX[k], dirY), _mm256_mul_ps(rayY[k], dirX));
+                __m256 t = _mm256_div_ps(tNumerator, denominator);
+                __m256 u = _mm256_div_ps(_mm256_sub_ps(_mm256_mul_ps(toStartX, rayY[k]), _mm256_mul_ps(toStartY, rayX[k])), denominator);
+                __m256 hit = _mm256_cmp_ps(_mm256_and_ps(denominator, absMask), epsilon, _CMP_GE_OQ);
+                hit = _mm256_and_ps(hit, _mm256_cmp_ps(t, zero, _CMP_GT_OQ));
+                hit = _mm256_and_ps(hit, _mm256_cmp_ps(u, zero, _CMP_GE_OQ));
+                hit = _mm256_and_ps(hit, _mm256_cmp_ps(u, one, _CMP_LE_OQ));
+                hit = _mm256_and_ps(hit, _mm256_cmp_ps(t, closest[k], _CMP_LT_OQ));
+                closest[k] = _mm256_blendv_ps(closest[k], t, hit);
+            }
+        }
+
+        for (int k = 0; k < groupSize; k++)
+        {
+            // horizontal min of the 8 lanes
+            __m128 m = _mm_min_ps(_mm256_castps256_ps128(closest[k]), _mm256_extractf128_ps(closest[k], 1));
+            m = _mm_min_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 3, 0, 1)));
+            m = _mm_min_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 0, 3, 2)));
+            distances[r + k] = _mm_cvtss_f32(m);
+        }
+    }
+}
+#endif
+
+static RayKernel rayKernel = NULL;
+static const char *rayKernelName = "scalar";
+
+// Pick the widest kernel the CPU supports. Only runs once
+static void selectRayKernel(void)
+{
+    rayKernel = castRaysScalar;
+    rayKernelName = "scalar";
+#ifdef EDGE_BUFFER_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        rayKernel = castRaysAVX2;
+        rayKernelName = "avx2";
+    }
+    else if (__builtin_cpu_supports("sse2"))
+    {
+        rayKernel = castRaysSSE;
+        rayKernelName = "sse2";
+    }
+#endif
+}
+
+const char *getRayKernelName(void)
+{
+    if (rayKernel == NULL)
+        selectRayKernel();
+    return rayKernelName;
+}
+
+/*
+Trace many rays from the same origin against every edge in the buffer.
+directions must be normalized. hits receives the closest hit of each ray, or the point at maxDistance
+*/
+void castRaysBatch(EdgeBuffer *buffer, Vector2 origin, const Vector2 *directions, int rayCount, float maxDistance, Vector2 *hits)
+{
+    if (rayKernel == NULL)
+        selectRayKernel();
+
+    // distances are computed in chunks on the stack, then turned into points
+    float distances[256];
+    for (int start = 0; start < rayCount; start += 256)
+    {
+        int count = rayCount - start < 256 ? rayCount - start : 256;
+        rayKernel(buffer, origin, directions + start, count, maxDistance, distances);
+        for (int i = 0; i < count; i++)
+        {
+            hits[start + i].x = origin.x + directions[start + i].x * distances[i];
+            hits[start + i].y = origin.y + directions[start + i].y * distances[i];
+        }
+    }
+}
+
+// Single ray version of castRaysBatch, same result as castRay over the original edges
+Vector2 castRaySoA(EdgeBuffer *buffer, Vector2 origin, Vector2 direction, float maxDistance)
+{
+    Vector2 hit;
+    castRaysBatch(buffer, origin, &direction, 1, maxDistance, &hit);
+    return hit;
+}
@@ -0,0 +1,33 @@
+#ifndef EDGE_BUFFER_H_
+#define EDGE_BUFFER_H_
+
+#include "raylib.h"
+#include "game_state.h"
+
+// Structs
+
+// Edges stored as a structure of arrays, so ray tests can run on 4 or 8 edges at once.
+// Every array is 32 byte aligned and padded to a multiple of 8 with empty edges (dirX = dirY = 0),
+// which can never be hit.
+typedef struct EdgeBuffer
+{
+    float *startX;
+    float *startY;
+    float *dirX;     // end.x - start.x
+    float *dirY;     // end.y - start.y
+    int count;       // number of real edges
+    int paddedCount; // count rounded up to a multiple of 8
+    int capacity;    // allocated floats per array
+    void *memory;    // single allocation backing all four arrays
+} EdgeBuffer;
+
+// Functions
+void buildEdgeBuffer(EdgeBuffer *buffer, Edge *edges, int edgeCount);
+void buildEdgeBufferInArena(EdgeBuffer *buffer, Edge *edges, int edgeCount, FrameArena *arena);
+void setEdgeBufferEdge(EdgeBuffer *buffer, int index, Edge *edge);
+void freeEdgeBuffer(EdgeBuffer *buffer);
+Vector2 castRaySoA(EdgeBuffer *buffer, Vector2 origin, Vector2 direction, float maxDistance);
+void castRaysBatch(EdgeBuffer *buffer, Vector2 origin, const Vector2 *directions, int rayCount, float maxDistance, Vector2 *hits);
+const char *getRayKernelName(void);
+
+#endif
@@ -0,0 +1,135 @@
+#include "frame_arena.h"
+#include <stdlib.h>
+#include <string.h>
+
+// every allocation is aligned to this, enough for SIMD loads
+#define ARENA_ALIGN 32
+// blocks start with a pointer to the block they replaced, padded to keep the data aligned
+#define ARENA_HEADER ARENA_ALIGN
+
+static size_t alignSize(size_t size)
+{
+    return (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+static unsigned char *blockData(unsigned char *block)
+{
+    // malloc only guarantees 16 bytes, round the data start up to the arena alignment
+    return (unsigned char *)(((size_t)(block + ARENA_HEADER) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1));
+}
+
+static unsigned char *newBlock(FrameArena *arena, size_t capacity, unsigned char *previous)
+{
+    unsigned char *block = malloc(ARENA_HEADER + ARENA_ALIGN + capacity);
+    memcpy(block, &previous, sizeof(previous));
+    arena->frame.systemAllocations++;
+    return block;
+}
+
+void initFrameArena(FrameArena *arena, size_t capacity)
+{
+    *arena = (FrameArena){0};
+    arena->capacity = alignSize(capacity);
+    arena->block = newBlock(arena, arena->capacity, NULL);
+}
+
+// free every block retired this frame, keeping the current one
+static void freeRetiredBlocks(FrameArena *arena)
+{
+    unsigned char *retired;
+    memcpy(&retired, arena->block, sizeof(retired));
+    while (retired != NULL)
+    {
+        unsigned char *previous;
+        memcpy(&previous, retired, sizeof(previous));
+        free(retired);
+        retired = previous;
+    }
+    unsigned char *none = NULL;
+    memcpy(arena->block, &none, sizeof(none));
+}
+
+void freeFrameArena(FrameArena *arena)
+{
+    if (arena->block != NULL)
+    {
+        freeRetiredBlocks(arena);
+        free(arena->block);
+    }
+    *arena = (FrameArena){0};
+}
+
+/*
+Start a new frame: everything allocated last frame is gone.
+If the last frame outgrew the block, replace it with one that fits the whole frame
+*/
+void resetFrameArena(FrameArena *arena)
+{
+    freeRetiredBlocks(arena);
+    if (arena->capacity < arena->highWater)
+    {
+        free(arena->block);
+        arena->capacity = alignSize(arena->highWater);
+        arena->block = newBlock(arena, arena->capacity, NULL);
+    }
+    arena->used = 0;
+    arena->retiredUsed = 0;
+    arena->highWater = 0;
+    arena->lastFrame = arena->frame;
+    arena->frame = (FrameArenaStats){0};
+}
+
+void *arenaAlloc(FrameArena *arena, size_t size)
+{
+    size = alignSize(size > 0 ? size : 1);
+    if (arena->used + size > arena->capacity)
+    {
+        // out of room: retire this block until the next reset and start a bigger one
+        size_t capacity = arena->capacity * 2;
+        if (capacity < size * 2)
+            capacity = size * 2;
+        arena->retiredUsed += arena->used;
+        arena->block = newBlock(arena, capacity, arena->block);
+        arena->capacity = capacity;
+        arena->used = 0;
+    }
+    void *memory = blockData(arena->block) + arena->used;
+    arena->used += size;
+    if (arena->retiredUsed + arena->used > arena->highWater)
+        arena->highWater = arena->retiredUsed + arena->used;
+    arena->frame.bytes += size;
+    arena->frame.allocations++;
+    return memory;
+}
+
+ArenaMark arenaMark(FrameArena *arena)
+{
+    return (ArenaMark){arena->block, arena->used};
+}
+
+// Give back everything allocated since the mark. If the arena grew since then, the memory is reclaimed at reset instead
+void arenaRelease(FrameArena *arena, ArenaMark mark)
+{
+    if (arena->block == mark.block)
+        arena->used = mark.used;
+}
+
+/*
+Make sure a persistent (not per frame) buffer can hold count elements.
+Grows geometrically and never shrinks, so steady state reuses the same memory. Counted in the arena's stats
+*/
+void *growBuffer(FrameArena *arena, void *buffer, int *capacity, int count, size_t elementSize)
+{
+    if (buffer != NULL && count <= *capacity)
+        return buffer;
+    int newCapacity = *capacity * 2;
+    if (newCapacity < count)
+        newCapacity = count;
+    if (newCapacity < 16)
+        newCapacity = 16;
+    buffer = realloc(buffer, newCapacity * elementSize);
+    *capacity = newCapacity;
+    if (arena != NULL)
+        arena->frame.systemAllocations++;
+    return buffer;
+}
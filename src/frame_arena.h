@@ -0,0 +1,48 @@
+#ifndef FRAME_ARENA_H_
+#define FRAME_ARENA_H_
+
+#include <stddef.h>
+#include "game_state.h"
+
+// Structs
+
+// Per frame allocation counters
+typedef struct FrameArenaStats
+{
+    size_t bytes;          // bytes handed out by arenaAlloc
+    int allocations;       // number of arenaAlloc calls
+    int systemAllocations; // number of malloc/realloc calls (arena growth and growBuffer). 0 once warmed up
+} FrameArenaStats;
+
+// Scratch memory that lives until the end of the frame.
+// Allocations bump a pointer into one block. When the block runs out a bigger one is started and the old one
+// is kept until the next reset, when everything is folded back into a single block big enough for the whole frame.
+// The arena never shrinks, so after the first few frames it stops calling malloc altogether.
+typedef struct FrameArena
+{
+    unsigned char *block;      // current block (starts with a pointer to the previous, retired, block)
+    size_t capacity;           // usable bytes in the current block
+    size_t used;               // bytes used in the current block
+    size_t retiredUsed;        // bytes used in blocks retired this frame
+    size_t highWater;          // most bytes live at once this frame
+    FrameArenaStats frame;     // counters for the frame in progress
+    FrameArenaStats lastFrame; // counters for the previous frame
+} FrameArena;
+
+// Position in the arena to roll back to with arenaRelease
+typedef struct ArenaMark
+{
+    unsigned char *block;
+    size_t used;
+} ArenaMark;
+
+// Functions
+void initFrameArena(FrameArena *arena, size_t capacity);
+void freeFrameArena(FrameArena *arena);
+void resetFrameArena(FrameArena *arena);
+void *arenaAlloc(FrameArena *arena, size_t size);
+ArenaMark arenaMark(FrameArena *arena);
+void arenaRelease(FrameArena *arena, ArenaMark mark);
+void *growBuffer(FrameArena *arena, void *buffer, int *capacity, int count, size_t elementSize);
+
+#endif
@@ -0,0 +1,385 @@
+#include "raylib.h"
+#include "raymath.h"
+#include "frame_pipeline.h"
+#include "game_state.h"
+#include "ray_casting.h"
+#include "lights.h"
+#include "chunks.h"
+#include "profiler.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// Move the player and camera alpha of the way from their previous state to the current one, for drawing
+static void interpolateSimulationState(GameState *game, Player *previousPlayer, PlayerCamera *previousCamera, float alpha)
+{
+    game->player->playerPos = Vector2Lerp(previousPlayer->playerPos, game->player->playerPos, alpha);
+    game->playerCamera->camPos = Vector2Lerp(previousCamera->camPos, game->playerCamera->camPos, alpha);
+    game->playerCamera->camera.target = Vector2Lerp(previousCamera->camera.target, game->playerCamera->camera.target, alpha);
+}
+
+// Copy a sight's triangles onto the end of the packet's. Returns the index of the first one
+static int addPacketTriangles(FramePacket *packet, SightTriangles *sight)
+{
+    int first = packet->triangleCount;
+    packet->triangles = growBuffer(NULL, packet->triangles, &packet->triangleCapacity, first + sight->triangleCount, sizeof(Triangle));
+    memcpy(packet->triangles + first, sight->triangles, sight->triangleCount * sizeof(Triangle));
+    packet->triangleCount += sight->triangleCount;
+    return first;
+}
+
+// Whether the packet already holds every sight on screen, left from the last time it was filled
+static bool packetSightsCurrent(FramePacket *packet, GameState *game)
+{
+    if (!visibilityCacheKeysEqual(&packet->playerKey, &game->playerSight.key))
+        return false;
+    int lightCount = 0;
+    for (int i = 0; i < game->lightCount; i++)
+    {
+        Light *light = &game->lights[i];
+        if (!light->onScreen)
+            continue;
+        if (lightCount == packet->lightCount)
+            return false;
+        PacketLight *packetLight = &packet->lights[lightCount];
+        lightCount++;
+        if (!visibilityCacheKeysEqual(&packetLight->key, &light->sight.key) || memcmp(&packetLight->color, &light->color, sizeof(Color)) != 0)
+            return false;
+    }
+    return lightCount == packet->lightCount;
+}
+
+// Copy every sight on screen into the packet
+static void copyPacketSights(FramePacket *packet, GameState *game)
+{
+    packet->triangleCount = 0;
+    packet->lightCount = 0;
+    addPacketTriangles(packet, &game->playerSight);
+    packet->playerTriangleCount = game->playerSight.triangleCount;
+    packet->playerKey = game->playerSight.key;
+    for (int i = 0; i < game->lightCount; i++)
+    {
+        Light *light = &game->lights[i];
+        if (!light->onScreen)
+            continue;
+        packet->lights = growBuffer(NULL, packet->lights, &packet->lightCapacity, packet->lightCount + 1, sizeof(PacketLight));
+        PacketLight *packetLight = &packet->lights[packet->lightCount];
+        packet->lightCount++;
+        packetLight->color = light->color;
+        packetLight->triangleCount = light->sight.triangleCount;
+        packetLight->firstTriangle = addPacketTriangles(packet, &light->sight);
+        packetLight->key = light->sight.key;
+    }
+}
+
+/*
+Record what the frame will draw. The sights are copied rather than handed over,
+their buffers stay with the game since the visibility cache reuses them.
+They aren't copied again if none were recalculated since this packet was last filled
+*/
+static void fillFramePacket(FramePacket *packet, GameState *game)
+{
+    packet->player = *game->player;
+    packet->camera = *game->playerCamera;
+    packet->useChunkWorld = game->useChunkWorld;
+    // the main thread merges these back before baking the tile layers
+    packet->dirtyTiles = game->roomTileLayerDirty;
+    game->roomTileLayerDirty = EMPTY_TILE_REGION;
+
+    if (!packetSightsCurrent(packet, game))
+        copyPacketSights(packet, game);
+
+    packet->arenaStats = game->frameArena->lastFrame;
+    packet->visibilityCacheStats = game->visibilityCacheStats;
+    packet->chunkCount = game->chunkWorld->chunkCount;
+    packet->chunkMemory = game->chunkWorld->memoryUsed;
+}
+
+// One frame of the simulation stage: catch up on updates, then calculate what can be seen from where they're drawn
+static void simulateFrame(FramePipeline *pipeline, FramePacket *packet)
+{
+    GameState *game = pipeline->game;
+    // scratch memory from last frame is no longer needed
+    resetFrameArena(game->frameArena);
+
+    PROFILE_BEGIN(updateGame);
+    pipeline->simulationTime += pipeline->frameTime;
+    if (pipeline->simulationTime > MAX_SIMULATION_STEPS * SIMULATION_STEP)
+        pipeline->simulationTime = MAX_SIMULATION_STEPS * SIMULATION_STEP;
+    while (pipeline->simulationTime >= SIMULATION_STEP)
+    {
+        pipeline->previousPlayer = *game->player;
+        pipeline->previousCamera = *game->playerCamera;
+        game->deltaTime = SIMULATION_STEP;
+        updateGame(game);
+        clearGameInputClicks(&game->input);
+        pipeline->simulationTime -= SIMULATION_STEP;
+    }
+    PROFILE_END(updateGame);
+
+    // visibility from where the player and camera are drawn, part way from the last update to the next
+    Player currentPlayer = *game->player;
+    PlayerCamera currentCamera = *game->playerCamera;
+    interpolateSimulationState(game, &pipeline->previousPlayer, &pipeline->previousCamera, pipeline->simulationTime / SIMULATION_STEP);
+    PROFILE_BEGIN(visibility);
+    startLightVisibility(game);
+    calculatePlayerSight(game, game->screenWidth);
+    waitLightVisibility(game);
+    PROFILE_END(visibility);
+    fillFramePacket(packet, game);
+    // back to the simulated state for the next update
+    *game->player = currentPlayer;
+    *game->playerCamera = currentCamera;
+}
+
+static void *runFramePipeline(void *arg)
+{
+    FramePipeline *pipeline = arg;
+    PROFILE_THREAD_NAME("simulation");
+    pthread_mutex_lock(&pipeline->mutex);
+    while (true)
+    {
+        while (!pipeline->simulating && !pipeline->quit)
+            pthread_cond_wait(&pipeline->condition, &pipeline->mutex);
+        if (pipeline->quit)
+            break;
+        int backPacket = 1 - pipeline->readyPacket;
+        pthread_mutex_unlock(&pipeline->mutex);
+
+        simulateFrame(pipeline, &pipeline->packets[backPacket]);
+
+        pthread_mutex_lock(&pipeline->mutex);
+        pipeline->readyPacket = backPacket;
+        pipeline->simulating = false;
+        pthread_cond_broadcast(&pipeline->condition);
+    }
+    pthread_mutex_unlock(&pipeline->mutex);
+    return NULL;
+}
+
+// Start the simulation thread. It makes the first packet right away, without updating
+void startFramePipeline(FramePipeline *pipeline, GameState *game)
+{
+    *pipeline = (FramePipeline){0};
+    pipeline->game = game;
+    pipeline->readyPacket = 1;
+    pipeline->previousPlayer = *game->player;
+    pipeline->previousCamera = *game->playerCamera;
+    pthread_mutex_init(&pipeline->mutex, NULL);
+    pthread_cond_init(&pipeline->condition, NULL);
+
+    pipeline->simulating = true;
+    pipeline->threaded = pthread_create(&pipeline->thread, NULL, runFramePipeline, pipeline) == 0;
+    if (!pipeline->threaded)
+    {
+        // no thread, simulate in place instead
+        pipeline->simulating = false;
+        simulateFrame(pipeline, &pipeline->packets[0]);
+        pipeline->readyPacket = 0;
+    }
+}
+
+// Stop the simulation thread, after it has finished its frame, and free the packets
+void stopFramePipeline(FramePipeline *pipeline)
+{
+    if (pipeline->threaded)
+    {
+        pthread_mutex_lock(&pipeline->mutex);
+        pipeline->quit = true;
+        pthread_cond_broadcast(&pipeline->condition);
+        pthread_mutex_unlock(&pipeline->mutex);
+        pthread_join(pipeline->thread, NULL);
+    }
+    pthread_mutex_destroy(&pipeline->mutex);
+    pthread_cond_destroy(&pipeline->condition);
+    for (int i = 0; i < 2; i++)
+    {
+        free(pipeline->packets[i].triangles);
+        free(pipeline->packets[i].lights);
+    }
+}
+
+/*
+Wait for the simulation thread to finish its frame and return the packet it made.
+The game state belongs to the main thread from here until resumeFramePipeline
+*/
+FramePacket *waitFramePacket(FramePipeline *pipeline)
+{
+    // time the main thread stalls on the simulation thread
+    PROFILE_BEGIN(waitFramePacket);
+    pthread_mutex_lock(&pipeline->mutex);
+    while (pipeline->simulating)
+        pthread_cond_wait(&pipeline->condition, &pipeline->mutex);
+    FramePacket *packet = &pipeline->packets[pipeline->readyPacket];
+    pthread_mutex_unlock(&pipeline->mutex);
+    PROFILE_END(waitFramePacket);
+    return packet;
+}
+
+/*
+Hand the game state back to the simulation thread, to simulate frameTime more and make the next packet.
+The packet from waitFramePacket stays untouched until the next waitFramePacket
+*/
+void resumeFramePipeline(FramePipeline *pipeline, float frameTime)
+{
+    pipeline->frameTime = frameTime;
+    if (!pipeline->threaded)
+    {
+        int backPacket = 1 - pipeline->readyPacket;
+        simulateFrame(pipeline, &pipeline->packets[backPacket]);
+        pipeline->readyPacket = backPacket;
+        return;
+    }
+    pthread_mutex_lock(&pipeline->mutex);
+    pipeline->simulating = true;
+    pthread_cond_broadcast(&pipeline->condition);
+    pthread_mutex_unlock(&pipeline->mutex);
+}
+
+// Draw the player's sight from a packet, through its camera, into a target 1/scale the size of the screen
+void drawPacketSight(FramePacket *packet, Color color, int scale)
+{
+    SightTriangles sight = {.triangles = packet->triangles, .triangleCount = packet->playerTriangleCount};
+    drawSightTriangles(&sight, getScaledCamera(packet->camera.camera, scale), color);
+}
+
+// Draw the on screen lights from a packet, each in its own color, into a target 1/scale the size of the screen
+void drawPacketLights(FramePacket *packet, int scale)
+{
+    Camera2D camera = getScaledCamera(packet->camera.camera, scale);
+    for (int i = 0; i < packet->lightCount; i++)
+    {
+        PacketLight *light = &packet->lights[i];
+        SightTriangles sight = {.triangles = packet->triangles + light->firstTriangle, .triangleCount = light->triangleCount};
+        drawSightTriangles(&sight, camera, light->color);
+    }
+}
+
+// The whole light texture from a packet on the CPU: the player's sight in white, the lights added on top
+void rasterizePacketLightMask(FramePacket *packet, LightMask *mask)
+{
+    clearLightMask(mask);
+    SightTriangles sight = {.triangles = packet->triangles, .triangleCount = packet->playerTriangleCount};
+    rasterizeSightTriangles(mask, &sight, packet->camera.camera, WHITE);
+    for (int i = 0; i < packet->lightCount; i++)
+    {
+        PacketLight *light = &packet->lights[i];
+        sight = (SightTriangles){.triangles = packet->triangles + light->firstTriangle, .triangleCount = light->triangleCount};
+        rasterizeSightTriangles(mask, &sight, packet->camera.camera, light->color);
+    }
+}
+
+// Grow region to cover a fan, in the pixels of a target drawn through camera
+static void growFanRegion(Rectangle *region, Triangle *triangles, int triangleCount, Camera2D camera)
+{
+    Matrix cameraMatrix = GetCameraMatrix2D(camera);
+    for (int i = 0; i < triangleCount; i++)
+    {
+        Vector2 points[3] = {triangles[i].point1, triangles[i].point2, triangles[i].point3};
+        for (int j = 0; j < 3; j++)
+        {
+            Vector2 point = Vector2Transform(points[j], cameraMatrix);
+            float minX = fminf(region->x, point.x);
+            float minY = fminf(region->y, point.y);
+            region->width = fmaxf(region->x + region->width, point.x) - minX;
+            region->height = fmaxf(region->y + region->height, point.y) - minY;
+            region->x = minX;
+            region->y = minY;
+        }
+    }
+}
+
+/*
+Work out what of a width x height light texture, drawn at 1/scale through the packet's camera, is out of date.
+Returns false if nothing is, otherwise sets region (in texture pixels, rounded out to whole ones).
+Either way the packet is remembered as what the texture will hold.
+A fan that changed is redrawn where it was and where it is now. If the camera moved, everything is
+*/
+bool getLightTextureChanges(LightTextureHistory *history, FramePacket *packet, int scale, int width, int height, Rectangle *region)
+{
+    Camera2D camera = getScaledCamera(packet->camera.camera, scale);
+    bool redrawAll = !history->drawn || history->scale != scale || memcmp(&history->camera, &camera, sizeof(Camera2D)) != 0;
+    bool changed = redrawAll;
+    // empty, anything added to it replaces the starting point
+    *region = (Rectangle){INFINITY, INFINITY, -INFINITY, -INFINITY};
+    if (!redrawAll)
+    {
+        // fan 0 is the player's sight, the rest are the lights
+        int fanCount = 1 + (packet->lightCount > history->lightCount ? packet->lightCount : history->lightCount);
+        for (int fan = 0; fan < fanCount; fan++)
+        {
+            Triangle *oldTriangles = NULL, *newTriangles = NULL;
+            int oldCount = 0, newCount = 0;
+            Color oldColor = WHITE, newColor = WHITE;
+            if (fan == 0)
+            {
+                oldTriangles = history->triangles;
+                oldCount = history->playerTriangleCount;
+                newTriangles = packet->triangles;
+                newCount = packet->playerTriangleCount;
+            }
+            else
+            {
+                if (fan <= history->lightCount)
+                {
+                    PacketLight *light = &history->lights[fan - 1];
+                    oldTriangles = history->triangles + light->firstTriangle;
+                    oldCount = light->triangleCount;
+                    oldColor = light->color;
+                }
+                if (fan <= packet->lightCount)
+                {
+                    PacketLight *light = &packet->lights[fan - 1];
+                    newTriangles = packet->triangles + light->firstTriangle;
+                    newCount = light->triangleCount;
+                    newColor = light->color;
+                }
+            }
+            if (oldCount == newCount && memcmp(&oldColor, &newColor, sizeof(Color)) == 0 &&
+                (newCount == 0 || memcmp(oldTriangles, newTriangles, newCount * sizeof(Triangle)) == 0))
+                continue;
+            changed = true;
+            growFanRegion(region, oldTriangles, oldCount, camera);
+            growFanRegion(region, newTriangles, newCount, camera);
+        }
+    }
+    if (!changed)
+        return false;
+
+    if (redrawAll)
+        *region = (Rectangle){0, 0, (float)width, (float)height};
+    else if (region->x != INFINITY)
+    {
+        // whole pixels, with one to spare for rounding, inside the texture
+        float minX = fmaxf(floorf(region->x) - 1, 0);
+        float minY = fmaxf(floorf(region->y) - 1, 0);
+        float maxX = fminf(ceilf(region->x + region->width) + 1, (float)width);
+        float maxY = fminf(ceilf(region->y + region->height) + 1, (float)height);
+        *region = (Rectangle){minX, minY, fmaxf(maxX - minX, 0), fmaxf(maxY - minY, 0)};
+    }
+    else
+    {
+        // only fans without triangles changed, nothing to draw but they're remembered all the same
+        *region = (Rectangle){0, 0, 0, 0};
+    }
+
+    history->drawn = true;
+    history->camera = camera;
+    history->scale = scale;
+    history->triangles = growBuffer(NULL, history->triangles, &history->triangleCapacity, packet->triangleCount, sizeof(Triangle));
+    memcpy(history->triangles, packet->triangles, packet->triangleCount * sizeof(Triangle));
+    history->triangleCount = packet->triangleCount;
+    history->playerTriangleCount = packet->playerTriangleCount;
+    history->lights = growBuffer(NULL, history->lights, &history->lightCapacity, packet->lightCount, sizeof(PacketLight));
+    if (packet->lightCount > 0)
+        memcpy(history->lights, packet->lights, packet->lightCount * sizeof(PacketLight));
+    history->lightCount = packet->lightCount;
+    return region->width > 0 && region->height > 0;
+}
+
+void freeLightTextureHistory(LightTextureHistory *history)
+{
+    free(history->triangles);
+    free(history->lights);
+    *history = (LightTextureHistory){0};
+}
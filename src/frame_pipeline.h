@@ -0,0 +1,118 @@
+#ifndef FRAME_PIPELINE_H_
+#define FRAME_PIPELINE_H_
+
+#include "raylib.h"
+#include "game_state.h"
+#include "player.h"
+#include "camera.h"
+#include "frame_arena.h"
+#include "light_mask.h"
+#include <pthread.h>
+#include <stddef.h>
+
+// the game updates at a fixed rate, whatever the frame rate, and frames are drawn between the last two updates
+#define SIMULATION_STEP (1.0f / 60.0f)
+// most updates run to catch up in one frame. after a long stall the rest is dropped, instead of every later frame
+// falling further behind trying to catch up
+#define MAX_SIMULATION_STEPS 5
+
+// Structs
+
+// A light's share of a frame packet's triangles
+typedef struct PacketLight
+{
+    Color color;
+    int firstTriangle;      // index into FramePacket.triangles
+    int triangleCount;
+    VisibilityCacheKey key; // of the light's sight when copied
+} PacketLight;
+
+/*
+Everything the light pass and the UI need to draw one frame, made by the simulation thread.
+Once handed over the main thread only reads it, while the simulation thread fills the other packet
+*/
+typedef struct FramePacket
+{
+    Player player;       // interpolated between the last two updates
+    PlayerCamera camera; // same
+    bool useChunkWorld;
+    TileRegion dirtyTiles; // room tiles changed by this packet's updates, for the room's tile layers
+    Triangle *triangles;   // the player's sight, then every light on screen
+    int triangleCount;
+    int triangleCapacity;
+    int playerTriangleCount;
+    VisibilityCacheKey playerKey; // of the player's sight when copied
+    PacketLight *lights;
+    int lightCount;
+    int lightCapacity;
+    // for the UI
+    FrameArenaStats arenaStats;
+    VisibilityCacheStats visibilityCacheStats;
+    int chunkCount;
+    size_t chunkMemory;
+} FramePacket;
+
+/*
+Two stage frame: the simulation thread updates the game and calculates visibility for the next frame
+while the main thread submits the current one to the GPU.
+The game state changes hands once a frame. Between waitFramePacket and resumeFramePipeline it belongs to the main
+thread (input, tile layers, the world pass), after that to the simulation thread until the next waitFramePacket.
+
+What overlaps: the next frame's updates, light visibility and player sight run alongside this frame's light pass
+(the light mask rasterizer included), compositing, UI and EndDrawing, which waits out the frame cap and the swap.
+What doesn't: the hand over of input, baking changed tiles into the tile layers, and recording the world pass.
+Those read the tiles, and in the chunk world the chunk table, which the simulation thread changes while it runs
+(edits, and loadChunk from gatherChunkEdges). Double buffering them would mean copying the chunk table every
+frame, or a lock around every chunk lookup, both dearer than the pass: it only bakes the tiles that changed,
+usually none, and queues one textured quad per tile layer block or chunk on screen, which the GPU draws later anyway.
+The hand over is one uncontended lock and broadcast each way per frame. waitFramePacket only blocks when the
+simulation takes longer than the main thread's half of the frame, and the profiler shows that time under its name
+*/
+typedef struct FramePipeline
+{
+    GameState *game;
+    FramePacket packets[2];
+    int readyPacket; // the packet the main thread draws. the simulation thread fills the other one
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t condition; // simulating changed, or the pipeline is shutting down
+    bool threaded;   // false if the thread couldn't be started, then resumeFramePipeline simulates on the spot
+    bool simulating; // the simulation thread owns the game state
+    bool quit;
+    float frameTime; // time to simulate, handed over by resumeFramePipeline
+    // simulation thread only
+    float simulationTime; // time not yet simulated
+    Player previousPlayer; // the player and camera as they were before the last update
+    PlayerCamera previousCamera;
+} FramePipeline;
+
+/*
+What a light texture (or light mask) was last drawn from, so the next frame only redraws what changed.
+Nothing at all if the camera and every fan are the same, which is most frames when nothing moves
+*/
+typedef struct LightTextureHistory
+{
+    bool drawn; // false until the first draw. clear it to have the next one redraw everything
+    Camera2D camera;
+    int scale;
+    Triangle *triangles; // copies of the packet's
+    int triangleCount;
+    int triangleCapacity;
+    int playerTriangleCount;
+    PacketLight *lights;
+    int lightCount;
+    int lightCapacity;
+} LightTextureHistory;
+
+// Functions
+void startFramePipeline(FramePipeline *pipeline, GameState *game);
+void stopFramePipeline(FramePipeline *pipeline);
+FramePacket *waitFramePacket(FramePipeline *pipeline);
+void resumeFramePipeline(FramePipeline *pipeline, float frameTime);
+void drawPacketSight(FramePacket *packet, Color color, int scale);
+void drawPacketLights(FramePacket *packet, int scale);
+void rasterizePacketLightMask(FramePacket *packet, LightMask *mask);
+bool getLightTextureChanges(LightTextureHistory *history, FramePacket *packet, int scale, int width, int height, Rectangle *region);
+void freeLightTextureHistory(LightTextureHistory *history);
+
+#endif
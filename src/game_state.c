@@ -3,7 +3,14 @@
 #include "camera.h"
 #include "player.h"
 #include <stdlib.h>
+#include <math.h>
 #include "world.h"
+#include "edge_buffer.h"
+#include "frame_arena.h"
+#include "ray_casting.h"
+#include "lights.h"
+#include "chunks.h"
+#include "replay.h"
 
 void InitGame(GameState *game)
 {
@@ -11,22 +18,126 @@ void InitGame(GameState *game)
     // init player before camera, as the camera requires some player info
     InitPlayer(game);
     InitCamera(game);
+    // scratch memory for visibility and edge building, grows to fit a frame and then stays put
+    game->frameArena = malloc(sizeof(FrameArena));
+    initFrameArena(game->frameArena, 64 * 1024);
 
     // init tile info
     game->tileSize = 32;
-    game->tileTextures[TILE_WALL] = LoadTexture("resources/wall.png");
-    game->tileTextures[TILE_FLOOR] = LoadTexture("resources/floor.png");
+    game->rayCastMode = RAYCAST_GRID;
+    game->visibilityAlgorithm = VISIBILITY_ANGULAR_SWEEP;
+    // textures need the GPU, the headless build never draws anything
+    if (!game->headless)
+    {
+        game->tileTextures[TILE_WALL] = LoadTexture("resources/wall.png");
+        game->tileTextures[TILE_FLOOR] = LoadTexture("resources/floor.png");
+    }
+    initTileCornersTable();
 
     loadRoomTiles(game, 16, 16);
     // calculate edges of tiles
     roomTilesToRoomLines(game);
+    // the big world is generated around the camera when switched to
+    game->chunkWorld = malloc(sizeof(ChunkWorld));
+    initChunkWorld(game->chunkWorld, 1337, CHUNK_MEMORY_BUDGET);
+
+    // worker threads for light visibility, one per spare core
+    initLights(game, 0);
 }
 
 void FreeGame(GameState *game)
 {
+    // stop the light workers before freeing anything they read
+    freeLights(game);
     free(game->playerCamera);
     free(game->player);
     free(game->roomTiles);
+    free(game->roomEdges);
+    free(game->freeEdgeIds);
+    free(game->roomTileEdges);
+    freeSightTriangles(&game->playerSight);
+    free(game->sightEdges);
+    unloadRoomTileLayers(game);
+    freeChunkWorld(game->chunkWorld);
+    free(game->chunkWorld);
+    freeFrameArena(game->frameArena);
+    free(game->frameArena);
+    if (game->roomEdgeBuffer != NULL)
+    {
+        freeEdgeBuffer(game->roomEdgeBuffer);
+        free(game->roomEdgeBuffer);
+    }
+}
+
+/*
+Advance the game by game->deltaTime, acting on game->input.
+Doesn't touch the window, so the headless build runs the same update with scripted input and a fixed step.
+Input and deltaTime come from game->inputReplay instead when replaying, and are logged to game->inputRecorder when recording
+*/
+void updateGame(GameState *game)
+{
+    if (game->inputReplay != NULL)
+        nextInputLogFrame(game->inputReplay, &game->input, &game->deltaTime);
+    if (game->inputRecorder != NULL)
+        recordInputFrame(game->inputRecorder, &game->input, game->deltaTime);
+    GameInput *input = &game->input;
+
+    // F2 switches between the room and the streamed chunk world
+    if (input->toggleWorld)
+        game->useChunkWorld = !game->useChunkWorld;
+
+    // Handle tile clicking
+    if (input->editTile && game->useChunkWorld)
+    {
+        Vector2 mousePosInWorld = GetScreenToWorld2D(input->mousePosition, game->playerCamera->camera);
+        int tileX = (int)floorf(mousePosInWorld.x / game->tileSize);
+        int tileY = (int)floorf(mousePosInWorld.y / game->tileSize);
+        TileType tileType = chunkWorldGetTile(game->chunkWorld, tileX, tileY);
+        chunkWorldSetTile(game, tileX, tileY, tileType == TILE_WALL ? TILE_FLOOR : TILE_WALL);
+    }
+    else if (input->editTile)
+    {
+        Vector2 mousePosInWorld = GetScreenToWorld2D(input->mousePosition, game->playerCamera->camera);
+
+        // Convert world position to tile coordinates
+        int tileX = (int)(mousePosInWorld.x / game->tileSize);
+        int tileY = (int)(mousePosInWorld.y / game->tileSize);
+
+        // Check if tile coordinates are valid
+        if (tileX >= 0 && tileX < game->roomWidth &&
+            tileY >= 0 && tileY < game->roomHeight)
+        {
+            TileType tileType = GET_TILE(game, tileX, tileY).tileType;
+
+            // Toggle between floor and wall, only the edges around the tile are rebuilt
+            if (tileType == TILE_FLOOR)
+                worldSetTile(game, tileX, tileY, TILE_WALL);
+            else if (tileType == TILE_WALL)
+                worldSetTile(game, tileX, tileY, TILE_FLOOR);
+        }
+    }
+
+    // Right click places a torch
+    if (input->placeLight)
+    {
+        Vector2 mousePosInWorld = GetScreenToWorld2D(input->mousePosition, game->playerCamera->camera);
+        addLight(game, mousePosInWorld, 200.0f, (Color){128, 85, 40, 255});
+    }
+
+    updatePlayer(game);
+    // update camera
+    updateCamera(game);
+    // stream chunks in around the new camera position
+    if (game->useChunkWorld)
+        updateChunkWorld(game);
+}
+
+// An update has acted on the presses, so the next one doesn't do it again. Held keys stay
+void clearGameInputClicks(GameInput *input)
+{
+    input->toggleWorld = false;
+    input->editTile = false;
+    input->placeLight = false;
 }
 
 void InitCamera(GameState *game)
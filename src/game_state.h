@@ -8,6 +8,14 @@ typedef struct Player Player;
 typedef struct PlayerCamera PlayerCamera;
 typedef struct Tile Tile;
 typedef struct Edge Edge;
+typedef struct TileEdges TileEdges;
+typedef struct EdgeBuffer EdgeBuffer;
+typedef struct FrameArena FrameArena;
+typedef struct Light Light;
+typedef struct LightWorkers LightWorkers;
+typedef struct ChunkWorld ChunkWorld;
+typedef struct InputRecorder InputRecorder;
+typedef struct InputLog InputLog;
 
 // Structs
 typedef enum TileType
@@ -23,38 +31,151 @@ typedef struct TileProperties
     TileType type;
     Color color;
     bool isSolid; // can this be collided with
+    bool isOpaque; // does this block light (walls get edges)
     const char *name;
 } TileProperties;
+// How rays are traced against the room edges
+typedef enum RayCastMode
+{
+    RAYCAST_GRID = 0,        // walk the tile grid (DDA) and only test edges on the tiles the ray passes
+    RAYCAST_BRUTE_FORCE = 1, // test every edge in the room (reference implementation)
+    RAYCAST_SIMD = 2,        // test every edge in range with the SSE/AVX2 kernel, over a SoA copy of them (edge_buffer.h)
+} RayCastMode;
+// How the visibility polygon is built
+typedef enum VisibilityAlgorithm
+{
+    VISIBILITY_RAY_FAN = 0,        // cast rays at every wall corner, see occluder_graph.h
+    VISIBILITY_ANGULAR_SWEEP = 1,  // sweep the endpoints by angle, keeping the nearest edge in a heap
+} VisibilityAlgorithm;
+// Rectangle of tiles, inclusive. Empty when minX > maxX
+typedef struct TileRegion
+{
+    int minX;
+    int minY;
+    int maxX;
+    int maxY;
+} TileRegion;
+#define EMPTY_TILE_REGION ((TileRegion){1, 1, 0, 0})
+static inline bool isTileRegionEmpty(TileRegion region)
+{
+    return region.minX > region.maxX || region.minY > region.maxY;
+}
+// Grow a region to include tile (x, y)
+static inline void growTileRegion(TileRegion *region, int x, int y)
+{
+    if (isTileRegionEmpty(*region))
+    {
+        *region = (TileRegion){x, y, x, y};
+        return;
+    }
+    region->minX = x < region->minX ? x : region->minX;
+    region->minY = y < region->minY ? y : region->minY;
+    region->maxX = x > region->maxX ? x : region->maxX;
+    region->maxY = y > region->maxY ? y : region->maxY;
+}
 typedef struct Triangle
 {
     Vector2 point1;
     Vector2 point2;
     Vector2 point3;
 } Triangle;
+// Origins closer than this (in pixels) share cached visibility
+#define VISIBILITY_CACHE_QUANTUM 0.5f
+// What a set of sight triangles was calculated for. If nothing in it changed, the triangles can be reused
+typedef struct VisibilityCacheKey
+{
+    bool valid;
+    int originX;              // origin, quantized to VISIBILITY_CACHE_QUANTUM
+    int originY;
+    float maxDistance;
+    const Edge *edges;
+    int edgeCount;
+    unsigned int edgeVersion; // roomEdgeVersion when calculated
+    bool chunkWorld;          // which world the edges came from
+    VisibilityAlgorithm algorithm;
+    RayCastMode rayCastMode;
+} VisibilityCacheKey;
+typedef struct VisibilityCacheStats
+{
+    int hits;
+    int misses;
+} VisibilityCacheStats;
+// A visibility polygon, as a fan of triangles around its origin, plus what it was calculated for
+typedef struct SightTriangles
+{
+    Triangle *triangles;
+    int triangleCount;
+    int triangleCapacity;
+    VisibilityCacheKey key;
+} SightTriangles;
+// What the player did this frame. Read from the keyboard and mouse by main.c, from a script by the headless build, or from a replay
+typedef struct GameInput
+{
+    bool moveUp; // W
+    bool moveDown; // S
+    bool moveLeft; // A
+    bool moveRight; // D
+    bool toggleWorld; // F2, switch between the room and the chunk world
+    bool editTile; // left click, toggle the tile under the mouse
+    bool placeLight; // right click, put a torch under the mouse
+    Vector2 mousePosition; // screen pixels
+} GameInput;
 typedef struct GameState
 {
     Player *player;             // player struct. defined in player.h
     PlayerCamera *playerCamera; // player camera struct. defined in camera.h
     int screenWidth;
     int screenHeight;
-    float deltaTime;   // time since last frame
+    float deltaTime;   // length of this update, set by the caller of updateGame. a fixed step in the game loop
+    GameInput input;   // this frame's input, set by the caller of updateGame
+    bool headless;     // no window or GPU context: textures are never loaded and nothing is drawn
+    InputRecorder *inputRecorder; // if set, updateGame logs its input and deltaTime. defined in replay.h
+    InputLog *inputReplay;        // if set, updateGame takes its input and deltaTime from here instead
     int tileSize;      // length of the side of one tile, in pixels
     Tile *roomTiles;   // single 1D array
     Edge *roomEdges;   // edges in the room, calculated from wall tiles
     int roomEdgeCount; // number of edges in the room (starting at 0)
+    int roomEdgeCapacity;
+    unsigned int roomEdgeVersion; // bumped every time roomEdges changes
+    int *freeEdgeIds;  // ids of roomEdges slots freed by worldSetTile, reused before the array grows
+    int freeEdgeCount;
+    int freeEdgeCapacity;
+    TileEdges *roomTileEdges; // per tile edge ids, same layout as roomTiles. used by the grid ray caster
+    int roomTileEdgeCapacity;
+    EdgeBuffer *roomEdgeBuffer; // roomEdges as a structure of arrays, used by the SIMD ray caster
     int roomWidth;     // width of the current room
     int roomHeight;    // height of the current room
-    Triangle *triangles;
-    int triangleCount;
+    RenderTexture2D *roomTileLayers; // the room's tiles drawn once, in blocks. only blocks near the camera are loaded, see bakeRoomTileLayer
+    int roomTileLayerColumns;
+    int roomTileLayerRows;
+    TileRegion roomTileLayerBlocks; // blocks that have a layer
+    TileRegion roomTileLayerDirty;  // tiles changed since the layers were drawn
+    SightTriangles playerSight; // what the player can see, rebuilt by calculatePlayerSight
+    Edge *sightEdges;           // edges in the player's sight range, gathered by calculatePlayerSight
+    int sightEdgeCapacity;
+    VisibilityCacheStats visibilityCacheStats;
+    Light *lights;              // every light in the room other than the player's. defined in lights.h
+    int lightCount;
+    int lightCapacity;
+    LightWorkers *lightWorkers; // thread pool calculating the lights' visibility
+    ChunkWorld *chunkWorld;     // unbounded streamed world, used instead of the room when useChunkWorld is set. defined in chunks.h
+    bool useChunkWorld;
+    FrameArena *frameArena; // scratch memory, reset at the start of every frame
+    RayCastMode rayCastMode;
+    VisibilityAlgorithm visibilityAlgorithm;
     Texture2D tileTextures[TILE_COUNT]; // textures for each tile type, indexed by TILE_TYPE
     Shader spotlightShader;
 } GameState;
 
 // Helper macro to access tiles like a 2D array
 #define GET_TILE(game, x, y) ((game)->roomTiles[(y) * (game)->roomWidth + (x)])
+// World position of a tile's top left corner. Tiles don't store it, it only depends on x, y
+#define GET_TILE_POSITION(game, x, y) ((Vector2){(float)(x) * (game)->tileSize, (float)(y) * (game)->tileSize})
 // Functions
 void InitGame(GameState *game);
 void FreeGame(GameState *game);
+void updateGame(GameState *game);
+void clearGameInputClicks(GameInput *input);
 void InitPlayer(GameState *game);
 void InitCamera(GameState *game);
 
@@ -0,0 +1,613 @@
+/*
+Headless build: the game's update and visibility without a window or GPU context.
+Built with `make headless`, separately from the game, since main.c needs a window.
+
+Time comes from a fixed step instead of the frame clock, and input from a script, or from a built in
+bot that wanders around editing tiles and placing lights when no script is given. Runs as fast as it can,
+for bots, soak tests and profiling the game logic on its own.
+
+    main_headless [script] [-ticks N] [-step seconds] [-seed N] [-trace file.json]
+                  [-record file.rec] [-replay file.rec] [-frames times.csv] [-lightmask scale] [-lightimage file.ppm]
+                  [-raycast grid|brute|simd] [-selfcheck edits]
+
+Prints the time per tick of every profiled stage at the end, and -trace saves the last ticks as a Chrome trace.
+-record logs every tick's input, and -replay plays such a log back (from the game or a headless run) instead of
+the script or bot, for as many ticks as it has unless -ticks says otherwise. -frames saves each tick's time as CSV.
+-lightmask also rasterizes the light texture on the CPU every tick, at 1/scale resolution, and -lightimage
+saves the last one as a PPM image (at full resolution unless -lightmask says otherwise).
+-raycast works out visibility with the ray fan instead of the sweep, casting its rays the given way.
+-selfcheck runs no ticks. It makes that many random worldSetTile edits to the room and to a big one, compares the edges and tile
+edge ids they leave with a full roomTilesToRoomLines every so often, and exits with 1 if any differ. `make test` runs it.
+
+Script lines are "<tick> <command> [arguments]", in tick order. # starts a comment
+    10 move 1 0       hold a direction from this tick on, x and y are -1, 0 or 1. "move 0 0" stops
+    50 edit 5 7       toggle tile (5, 7), of the room or the chunk world, whichever is active
+    80 light 300 200  put a torch at world position (300, 200)
+    90 world          switch between the room and the chunk world
+    500 quit          stop, even if -ticks asks for more
+*/
+#include "raylib.h"
+#include "game_state.h"
+#include "player.h"
+#include "camera.h"
+#include "frame_arena.h"
+#include "ray_casting.h"
+#include "lights.h"
+#include "world.h"
+#include "profiler.h"
+#include "replay.h"
+#include "light_mask.h"
+#include "edge_buffer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define DEFAULT_TICKS 10000
+#define DEFAULT_STEP (1.0f / 60.0f)
+#define MAX_SCRIPT_LINE 256
+// most torches the bot places
+#define BOT_MAX_LIGHTS 8
+// edits between -selfcheck's comparisons with a full rebuild
+#define SELFCHECK_INTERVAL 50
+// side of the square of tiles each run of edits stays in
+#define SELFCHECK_WINDOW 24
+// -selfcheck also edits a room this big, past PARALLEL_EDGE_MIN_TILES so the rebuild is split in bands
+#define SELFCHECK_BIG_ROOM_WIDTH 600
+#define SELFCHECK_BIG_ROOM_HEIGHT 520
+
+typedef enum ScriptCommand
+{
+    SCRIPT_MOVE,
+    SCRIPT_EDIT,
+    SCRIPT_LIGHT,
+    SCRIPT_WORLD,
+    SCRIPT_QUIT
+} ScriptCommand;
+
+typedef struct ScriptEvent
+{
+    int tick;
+    ScriptCommand command;
+    float x;
+    float y;
+} ScriptEvent;
+
+typedef struct Script
+{
+    ScriptEvent *events;
+    int eventCount;
+    int eventCapacity;
+    int nextEvent; // first event not run yet
+} Script;
+
+// Read a script file. Returns false if it can't be opened or a line doesn't parse
+static bool loadScript(Script *script, const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+    {
+        fprintf(stderr, "can't open script %s\n", path);
+        return false;
+    }
+
+    char line[MAX_SCRIPT_LINE];
+    int lineNumber = 0;
+    bool ok = true;
+    while (ok && fgets(line, sizeof(line), file) != NULL)
+    {
+        lineNumber++;
+        line[strcspn(line, "\r\n")] = '\0';
+        char *comment = strchr(line, '#');
+        if (comment != NULL)
+            *comment = '\0';
+
+        ScriptEvent event = {0};
+        char command[16];
+        int fields = sscanf(line, "%d %15s %f %f", &event.tick, command, &event.x, &event.y);
+        if (fields <= 0)
+            continue; // blank line
+        if (fields == 4 && strcmp(command, "move") == 0)
+            event.command = SCRIPT_MOVE;
+        else if (fields == 4 && strcmp(command, "edit") == 0)
+            event.command = SCRIPT_EDIT;
+        else if (fields == 4 && strcmp(command, "light") == 0)
+            event.command = SCRIPT_LIGHT;
+        else if (fields == 2 && strcmp(command, "world") == 0)
+            event.command = SCRIPT_WORLD;
+        else if (fields == 2 && strcmp(command, "quit") == 0)
+            event.command = SCRIPT_QUIT;
+        else
+        {
+            fprintf(stderr, "%s:%d: can't parse \"%s\"\n", path, lineNumber, line);
+            ok = false;
+            continue;
+        }
+
+        if (script->eventCount == script->eventCapacity)
+        {
+            script->eventCapacity = script->eventCapacity == 0 ? 64 : script->eventCapacity * 2;
+            script->events = realloc(script->events, script->eventCapacity * sizeof(ScriptEvent));
+        }
+        script->events[script->eventCount] = event;
+        script->eventCount++;
+    }
+    fclose(file);
+    return ok;
+}
+
+// Point the mouse at a world position, through the camera as it is before this tick's update
+static void aimMouse(GameState *game, Vector2 worldPosition)
+{
+    game->input.mousePosition = GetWorldToScreen2D(worldPosition, game->playerCamera->camera);
+}
+
+static void holdDirection(GameInput *input, int x, int y)
+{
+    input->moveLeft = x < 0;
+    input->moveRight = x > 0;
+    input->moveUp = y < 0;
+    input->moveDown = y > 0;
+}
+
+// Set this tick's input from the script's events for it. Returns false once the script says to quit
+static bool runScript(GameState *game, Script *script, int tick)
+{
+    while (script->nextEvent < script->eventCount && script->events[script->nextEvent].tick <= tick)
+    {
+        ScriptEvent *event = &script->events[script->nextEvent];
+        script->nextEvent++;
+        switch (event->command)
+        {
+        case SCRIPT_MOVE:
+            holdDirection(&game->input, (int)event->x, (int)event->y);
+            break;
+        case SCRIPT_EDIT:
+            aimMouse(game, (Vector2){(event->x + 0.5f) * game->tileSize, (event->y + 0.5f) * game->tileSize});
+            game->input.editTile = true;
+            break;
+        case SCRIPT_LIGHT:
+            aimMouse(game, (Vector2){event->x, event->y});
+            game->input.placeLight = true;
+            break;
+        case SCRIPT_WORLD:
+            game->input.toggleWorld = true;
+            break;
+        default:
+            return false;
+        }
+    }
+    return true;
+}
+
+// Small LCG, so a bot run with the same seed does the same thing on every platform
+static unsigned int nextRandom(unsigned int *state)
+{
+    *state = *state * 1664525u + 1013904223u;
+    return *state >> 8;
+}
+
+// Wander around, changing direction every couple of seconds, toggling tiles and placing a few torches
+static void runBot(GameState *game, unsigned int *seed, int tick)
+{
+    if (tick % 120 == 0)
+    {
+        int x = (int)(nextRandom(seed) % 3) - 1;
+        int y = (int)(nextRandom(seed) % 3) - 1;
+        // head back when outside the room, that's where the walls are
+        Vector2 position = game->player->playerPos;
+        float roomRight = (float)game->roomWidth * game->tileSize;
+        float roomBottom = (float)game->roomHeight * game->tileSize;
+        if (!game->useChunkWorld && (position.x < 0 || position.x > roomRight || position.y < 0 || position.y > roomBottom))
+        {
+            x = position.x < roomRight / 2 ? 1 : -1;
+            y = position.y < roomBottom / 2 ? 1 : -1;
+        }
+        holdDirection(&game->input, x, y);
+    }
+
+    if (tick % 15 == 0)
+    {
+        int tileX;
+        int tileY;
+        if (game->useChunkWorld)
+        {
+            // somewhere around the player, the chunk world has no bounds
+            tileX = (int)(game->player->playerPos.x / game->tileSize) + (int)(nextRandom(seed) % 13) - 6;
+            tileY = (int)(game->player->playerPos.y / game->tileSize) + (int)(nextRandom(seed) % 13) - 6;
+        }
+        else
+        {
+            tileX = (int)(nextRandom(seed) % game->roomWidth);
+            tileY = (int)(nextRandom(seed) % game->roomHeight);
+        }
+        aimMouse(game, (Vector2){(tileX + 0.5f) * game->tileSize, (tileY + 0.5f) * game->tileSize});
+        game->input.editTile = true;
+    }
+    else if (tick % 600 == 301 && game->lightCount < BOT_MAX_LIGHTS)
+    {
+        Vector2 position = game->player->playerPos;
+        position.x += (float)(nextRandom(seed) % 400) - 200;
+        position.y += (float)(nextRandom(seed) % 400) - 200;
+        aimMouse(game, position);
+        game->input.placeLight = true;
+    }
+
+    // every so often, a while in the chunk world
+    if (tick % 3000 == 2000 || tick % 3000 == 2999)
+        game->input.toggleWorld = true;
+}
+
+// Order edges by where they are, so two lists of the same edges compare equal whatever their ids
+static int compareEdges(const void *a, const void *b)
+{
+    const Edge *x = a;
+    const Edge *y = b;
+    float keysX[4] = {x->start.y, x->start.x, x->end.y, x->end.x};
+    float keysY[4] = {y->start.y, y->start.x, y->end.y, y->end.x};
+    for (int i = 0; i < 4; i++)
+    {
+        if (keysX[i] != keysY[i])
+            return keysX[i] < keysY[i] ? -1 : 1;
+    }
+    return 0;
+}
+
+// What the room's edges look like, without the ids: the live edges in order, and the edge on each side of every tile
+typedef struct EdgeSnapshot
+{
+    Edge *edges;
+    int edgeCount;
+    Edge *tileSides; // 4 per tile, north, east, south, west. visited is false where the side has no edge
+    bool *walls;     // TileEdges.isWall of every tile
+} EdgeSnapshot;
+
+// Field by field, Edge has padding after visited
+static bool sameEdge(const Edge *a, const Edge *b)
+{
+    return a->visited == b->visited && compareEdges(a, b) == 0;
+}
+
+static Edge getTileSideEdge(GameState *game, int edgeId)
+{
+    if (edgeId == -1)
+        return (Edge){0};
+    return game->roomEdges[edgeId];
+}
+
+static void takeEdgeSnapshot(GameState *game, EdgeSnapshot *snapshot)
+{
+    int tileCount = game->roomWidth * game->roomHeight;
+    snapshot->edges = malloc((game->roomEdgeCount + 1) * sizeof(Edge));
+    snapshot->edgeCount = 0;
+    for (int i = 0; i < game->roomEdgeCount; i++)
+    {
+        if (game->roomEdges[i].visited)
+            snapshot->edges[snapshot->edgeCount++] = game->roomEdges[i];
+    }
+    qsort(snapshot->edges, snapshot->edgeCount, sizeof(Edge), compareEdges);
+    snapshot->tileSides = malloc(tileCount * 4 * sizeof(Edge));
+    snapshot->walls = malloc(tileCount * sizeof(bool));
+    for (int i = 0; i < tileCount; i++)
+    {
+        TileEdges *tileEdges = &game->roomTileEdges[i];
+        snapshot->tileSides[i * 4 + DIRECTION_NORTH] = getTileSideEdge(game, tileEdges->northEdgeId);
+        snapshot->tileSides[i * 4 + DIRECTION_EAST] = getTileSideEdge(game, tileEdges->eastEdgeId);
+        snapshot->tileSides[i * 4 + DIRECTION_SOUTH] = getTileSideEdge(game, tileEdges->southEdgeId);
+        snapshot->tileSides[i * 4 + DIRECTION_WEST] = getTileSideEdge(game, tileEdges->westEdgeId);
+        snapshot->walls[i] = tileEdges->isWall;
+    }
+}
+
+static void freeEdgeSnapshot(EdgeSnapshot *snapshot)
+{
+    free(snapshot->edges);
+    free(snapshot->tileSides);
+    free(snapshot->walls);
+}
+
+// The SIMD ray caster's copy has to match roomEdges slot for slot, freed slots included
+static bool edgeBufferMatches(GameState *game)
+{
+    EdgeBuffer *buffer = game->roomEdgeBuffer;
+    if (buffer->count != game->roomEdgeCount)
+        return false;
+    for (int i = 0; i < game->roomEdgeCount; i++)
+    {
+        Edge *edge = &game->roomEdges[i];
+        if (buffer->startX[i] != edge->start.x || buffer->startY[i] != edge->start.y ||
+            buffer->dirX[i] != edge->end.x - edge->start.x || buffer->dirY[i] != edge->end.y - edge->start.y)
+            return false;
+    }
+    return true;
+}
+
+/*
+Compare what the edits left with a full rebuild of the same map, which then becomes the starting point of the next edits.
+Prints what differs and returns false on a mismatch
+*/
+static bool checkEdgesAgainstRebuild(GameState *game, int edit)
+{
+    bool ok = true;
+    if (!edgeBufferMatches(game))
+    {
+        fprintf(stderr, "selfcheck: after %d edits, the SoA edge buffer doesn't match roomEdges\n", edit);
+        ok = false;
+    }
+    EdgeSnapshot edited;
+    EdgeSnapshot rebuilt;
+    takeEdgeSnapshot(game, &edited);
+    roomTilesToRoomLines(game);
+    takeEdgeSnapshot(game, &rebuilt);
+
+    bool edgesMatch = edited.edgeCount == rebuilt.edgeCount;
+    for (int i = 0; edgesMatch && i < edited.edgeCount; i++)
+    {
+        edgesMatch = sameEdge(&edited.edges[i], &rebuilt.edges[i]);
+    }
+    if (!edgesMatch)
+    {
+        fprintf(stderr, "selfcheck: after %d edits, %d edges where a rebuild has %d, or they differ\n", edit, edited.edgeCount, rebuilt.edgeCount);
+        ok = false;
+    }
+    int tileCount = game->roomWidth * game->roomHeight;
+    for (int i = 0; i < tileCount * 4; i++)
+    {
+        if (!sameEdge(&edited.tileSides[i], &rebuilt.tileSides[i]))
+        {
+            fprintf(stderr, "selfcheck: after %d edits, side %d of tile (%d, %d) has the wrong edge\n", edit, i % 4, (i / 4) % game->roomWidth, (i / 4) / game->roomWidth);
+            ok = false;
+            break;
+        }
+    }
+    if (memcmp(edited.walls, rebuilt.walls, tileCount * sizeof(bool)) != 0)
+    {
+        fprintf(stderr, "selfcheck: after %d edits, the tiles' isWall flags differ\n", edit);
+        ok = false;
+    }
+    freeEdgeSnapshot(&edited);
+    freeEdgeSnapshot(&rebuilt);
+    return ok;
+}
+
+/*
+-selfcheck: random worldSetTile edits to the room, checked against roomTilesToRoomLines every
+SELFCHECK_INTERVAL edits and at the end. Each run of edits stays in one small window of the room, so they
+run into each other's edges. Returns the number of checks that failed
+*/
+static int runSelfCheck(GameState *game, unsigned int *seed, int editCount)
+{
+    int failures = 0;
+    int checks = 0;
+    int windowSize = game->roomWidth < SELFCHECK_WINDOW ? game->roomWidth : SELFCHECK_WINDOW;
+    int windowHeight = game->roomHeight < SELFCHECK_WINDOW ? game->roomHeight : SELFCHECK_WINDOW;
+    int windowX = 0;
+    int windowY = 0;
+    for (int edit = 1; edit <= editCount; edit++)
+    {
+        if (edit % SELFCHECK_INTERVAL == 1)
+        {
+            windowX = (int)(nextRandom(seed) % (game->roomWidth - windowSize + 1));
+            windowY = (int)(nextRandom(seed) % (game->roomHeight - windowHeight + 1));
+        }
+        int x = windowX + (int)(nextRandom(seed) % windowSize);
+        int y = windowY + (int)(nextRandom(seed) % windowHeight);
+        worldSetTile(game, x, y, nextRandom(seed) % 2 ? TILE_WALL : TILE_FLOOR);
+        if (edit % SELFCHECK_INTERVAL == 0 || edit == editCount)
+        {
+            checks++;
+            if (!checkEdgesAgainstRebuild(game, edit))
+                failures++;
+        }
+    }
+    printf("selfcheck: %d edits to a %dx%d room, %d checks against a full rebuild, %d failed\n", editCount, game->roomWidth, game->roomHeight, checks, failures);
+    return failures;
+}
+
+static double getSeconds(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+    const char *scriptPath = NULL;
+    int ticks = DEFAULT_TICKS;
+    float step = DEFAULT_STEP;
+    unsigned int seed = 1;
+    const char *tracePath = NULL;
+    const char *recordPath = NULL;
+    const char *replayPath = NULL;
+    const char *framesPath = NULL;
+    const char *lightImagePath = NULL;
+    int lightMaskScale = 0; // 0 doesn't rasterize
+    bool rayFan = false;
+    int selfCheckEdits = 0;
+    RayCastMode rayCastMode = RAYCAST_GRID;
+    bool ticksGiven = false;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-ticks") == 0 && i + 1 < argc)
+        {
+            ticks = atoi(argv[++i]);
+            ticksGiven = true;
+        }
+        else if (strcmp(argv[i], "-step") == 0 && i + 1 < argc)
+            step = (float)atof(argv[++i]);
+        else if (strcmp(argv[i], "-seed") == 0 && i + 1 < argc)
+            seed = (unsigned int)strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "-trace") == 0 && i + 1 < argc)
+            tracePath = argv[++i];
+        else if (strcmp(argv[i], "-record") == 0 && i + 1 < argc)
+            recordPath = argv[++i];
+        else if (strcmp(argv[i], "-replay") == 0 && i + 1 < argc)
+            replayPath = argv[++i];
+        else if (strcmp(argv[i], "-frames") == 0 && i + 1 < argc)
+            framesPath = argv[++i];
+        else if (strcmp(argv[i], "-lightmask") == 0 && i + 1 < argc)
+        {
+            lightMaskScale = atoi(argv[++i]);
+            if (lightMaskScale < 1)
+                lightMaskScale = 1;
+        }
+        else if (strcmp(argv[i], "-lightimage") == 0 && i + 1 < argc)
+            lightImagePath = argv[++i];
+        else if (strcmp(argv[i], "-raycast") == 0 && i + 1 < argc && parseRayCastMode(argv[i + 1], &rayCastMode))
+        {
+            rayFan = true;
+            i++;
+        }
+        else if (strcmp(argv[i], "-selfcheck") == 0 && i + 1 < argc)
+            selfCheckEdits = atoi(argv[++i]);
+        else if (argv[i][0] != '-')
+            scriptPath = argv[i];
+        else
+        {
+            fprintf(stderr, "usage: %s [script] [-ticks N] [-step seconds] [-seed N] [-trace file.json] [-record file.rec] [-replay file.rec] [-frames times.csv] [-lightmask scale] [-lightimage file.ppm] [-raycast grid|brute|simd] [-selfcheck edits]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    Script script = {0};
+    if (scriptPath != NULL && !loadScript(&script, scriptPath))
+        return 1;
+
+    // same screen size as the game, it decides the camera view and sight range
+    GameState game = {0};
+    game.screenWidth = 800;
+    game.screenHeight = 800;
+    game.headless = true;
+
+    InputLog replay = {0};
+    if (replayPath != NULL)
+    {
+        if (!loadInputLog(&replay, replayPath))
+        {
+            fprintf(stderr, "can't read replay %s\n", replayPath);
+            return 1;
+        }
+        game.screenWidth = replay.screenWidth;
+        game.screenHeight = replay.screenHeight;
+        game.inputReplay = &replay;
+        if (!ticksGiven)
+            ticks = replay.frameCount;
+    }
+    InitGame(&game);
+    if (rayFan)
+    {
+        game.visibilityAlgorithm = VISIBILITY_RAY_FAN;
+        game.rayCastMode = rayCastMode;
+    }
+    if (selfCheckEdits > 0)
+    {
+        // the game's room, then a big one
+        int failures = runSelfCheck(&game, &seed, selfCheckEdits);
+        loadRoomTiles(&game, SELFCHECK_BIG_ROOM_WIDTH, SELFCHECK_BIG_ROOM_HEIGHT);
+        roomTilesToRoomLines(&game);
+        failures += runSelfCheck(&game, &seed, selfCheckEdits);
+        FreeGame(&game);
+        return failures > 0 ? 1 : 0;
+    }
+    InputRecorder recorder = {0};
+    if (recordPath != NULL)
+    {
+        if (!startInputRecording(&recorder, recordPath, &game))
+        {
+            fprintf(stderr, "can't create %s\n", recordPath);
+            return 1;
+        }
+        game.inputRecorder = &recorder;
+    }
+    FrameTimes frameTimes = {0};
+    if (lightImagePath != NULL && lightMaskScale == 0)
+        lightMaskScale = 1;
+    LightMask lightMask = {0};
+    if (lightMaskScale > 0)
+        initLightMask(&lightMask, game.screenWidth, game.screenHeight, lightMaskScale);
+
+    PROFILE_THREAD_NAME("main");
+    double startTime = getSeconds();
+    int tick = 0;
+    for (; tick < ticks; tick++)
+    {
+        PROFILE_FRAME();
+        uint64_t tickStart = profilerNow();
+        // scratch memory from last tick is no longer needed
+        resetFrameArena(game.frameArena);
+
+        // held keys carry over from tick to tick, clicks only last one
+        clearGameInputClicks(&game.input);
+        // a replay needs nothing here, updateGame reads it
+        if (replayPath == NULL && scriptPath != NULL)
+        {
+            if (!runScript(&game, &script, tick))
+                break;
+        }
+        else if (replayPath == NULL)
+        {
+            runBot(&game, &seed, tick);
+        }
+
+        game.deltaTime = step;
+        PROFILE_SCOPE(updateGame)
+        updateGame(&game);
+
+        // the visibility the game would draw this frame
+        PROFILE_BEGIN(visibility);
+        startLightVisibility(&game);
+        calculatePlayerSight(&game, game.screenWidth);
+        waitLightVisibility(&game);
+        PROFILE_END(visibility);
+        if (lightMaskScale > 0)
+        {
+            // what the game draws into the light texture
+            PROFILE_BEGIN(lightMask);
+            clearLightMask(&lightMask);
+            rasterizeSightTriangles(&lightMask, &game.playerSight, game.playerCamera->camera, WHITE);
+            rasterizeLights(&game, &lightMask);
+            PROFILE_END(lightMask);
+        }
+        addFrameTime(&frameTimes, (profilerNow() - tickStart) / 1e6);
+    }
+    // the last tick ends here
+    PROFILE_FRAME();
+    double elapsed = getSeconds() - startTime;
+
+    printf("%d ticks in %.3f s: %.0f ticks/s, %.1f us/tick\n", tick, elapsed, tick / elapsed, elapsed * 1e6 / (tick > 0 ? tick : 1));
+    printf("player at (%.2f, %.2f), %s, %d room edges, %d lights, %d sight triangles\n",
+           game.player->playerPos.x, game.player->playerPos.y, game.useChunkWorld ? "chunk world" : "room",
+           game.roomEdgeCount, game.lightCount, game.playerSight.triangleCount);
+    if (game.visibilityAlgorithm == VISIBILITY_RAY_FAN)
+        printf("visibility: ray fan, %s rays\n", getRayCastModeName(game.rayCastMode));
+    else
+        printf("visibility: angular sweep\n");
+    printf("visibility cache: %d hits, %d misses\n", game.visibilityCacheStats.hits, game.visibilityCacheStats.misses);
+    printFrameTimes(&frameTimes, stdout);
+    if (framesPath != NULL && !writeFrameTimes(&frameTimes, framesPath))
+        fprintf(stderr, "can't write %s\n", framesPath);
+    if (lightMaskScale > 0)
+        printf("light mask: %dx%d, %s spans\n", lightMask.width, lightMask.height, getLightMaskKernelName());
+    if (lightImagePath != NULL && !writeLightMask(&lightMask, lightImagePath))
+        fprintf(stderr, "can't write %s\n", lightImagePath);
+    if (recordPath != NULL)
+        printf("recorded %d ticks to %s\n", recorder.frameCount, recordPath);
+
+    ProfileStageStats stats[PROFILER_MAX_STAGES];
+    int stageCount = getProfilerStageStats(stats, PROFILER_MAX_STAGES, PROFILER_FRAMES);
+    for (int i = 0; i < stageCount; i++)
+    {
+        printf("%-24s avg %7.3f ms  p99 %7.3f ms  max %7.3f ms per tick\n", stats[i].name, stats[i].averageMs, stats[i].p99Ms, stats[i].maxMs);
+    }
+    if (tracePath != NULL && !writeProfilerTrace(tracePath, PROFILER_FRAMES))
+        fprintf(stderr, "can't write trace %s\n", tracePath);
+
+    stopInputRecording(&recorder);
+    freeInputLog(&replay);
+    freeFrameTimes(&frameTimes);
+    freeLightMask(&lightMask);
+    FreeGame(&game);
+    free(script.events);
+    return 0;
+}
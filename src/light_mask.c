@@ -0,0 +1,259 @@
+#include "raylib.h"
+#include "raymath.h"
+#include "light_mask.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// SSE2/AVX2 span kernels are only built for x86 with gcc/clang, like the ray kernels in edge_buffer.c
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define LIGHT_MASK_X86
+#include <immintrin.h>
+#endif
+
+// Adds color to count pixels in a row, each channel saturating at 255
+typedef void (*SpanKernel)(uint32_t *pixels, int count, uint32_t color);
+
+static void addSpanScalar(uint32_t *pixels, int count, uint32_t color)
+{
+    const unsigned char *add = (const unsigned char *)&color;
+    unsigned char *bytes = (unsigned char *)pixels;
+    for (int i = 0; i < count * 4; i++)
+    {
+        int sum = bytes[i] + add[i & 3];
+        bytes[i] = sum > 255 ? 255 : sum;
+    }
+}
+
+#ifdef LIGHT_MASK_X86
+__attribute__((target("sse2"))) static void addSpanSSE(uint32_t *pixels, int count, uint32_t color)
+{
+    const __m128i add = _mm_set1_epi32((int)color);
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128i *block = (__m128i *)(pixels + i);
+        _mm_storeu_si128(block, _mm_adds_epu8(_mm_loadu_si128(block), add));
+    }
+    addSpanScalar(pixels + i, count - i, color);
+}
+
+__attribute__((target("avx2"))) static void addSpanAVX2(uint32_t *pixels, int count, uint32_t color)
+{
+    const __m256i add = _mm256_set1_epi32((int)color);
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256i *block = (__m256i *)(pixels + i);
+        _mm256_storeu_si256(block, _mm256_adds_epu8(_mm256_loadu_si256(block), add));
+    }
+    addSpanScalar(pixels + i, count - i, color);
+}
+#endif
+
+static SpanKernel spanKernel = NULL;
+static const char *spanKernelName = "scalar";
+
+// Pick the widest kernel the CPU supports. Only runs once
+static void selectSpanKernel(void)
+{
+    spanKernel = addSpanScalar;
+    spanKernelName = "scalar";
+#ifdef LIGHT_MASK_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        spanKernel = addSpanAVX2;
+        spanKernelName = "avx2";
+    }
+    else if (__builtin_cpu_supports("sse2"))
+    {
+        spanKernel = addSpanSSE;
+        spanKernelName = "sse2";
+    }
+#endif
+}
+
+const char *getLightMaskKernelName(void)
+{
+    if (spanKernel == NULL)
+        selectSpanKernel();
+    return spanKernelName;
+}
+
+// A mask the size of the screen divided by scale, rounded up. Nothing is uploaded until uploadLightMask
+void initLightMask(LightMask *mask, int screenWidth, int screenHeight, int scale)
+{
+    *mask = (LightMask){0};
+    mask->scale = scale < 1 ? 1 : scale;
+    mask->width = (screenWidth + mask->scale - 1) / mask->scale;
+    mask->height = (screenHeight + mask->scale - 1) / mask->scale;
+    mask->pixels = malloc((size_t)mask->width * mask->height * sizeof(uint32_t));
+    setLightMaskClip(mask, 0, 0, mask->width, mask->height);
+    clearLightMask(mask);
+    if (spanKernel == NULL)
+        selectSpanKernel();
+}
+
+// Needs the OpenGL context if the mask was ever uploaded
+void freeLightMask(LightMask *mask)
+{
+    if (mask->texture.id != 0)
+        UnloadTexture(mask->texture);
+    free(mask->pixels);
+    *mask = (LightMask){0};
+}
+
+// Limit clearing and drawing to a rectangle of the mask, like a scissor. The whole mask is (0, 0, width, height)
+void setLightMaskClip(LightMask *mask, int x, int y, int width, int height)
+{
+    mask->clipMinX = x < 0 ? 0 : x;
+    mask->clipMinY = y < 0 ? 0 : y;
+    mask->clipMaxX = x + width > mask->width ? mask->width : x + width;
+    mask->clipMaxY = y + height > mask->height ? mask->height : y + height;
+}
+
+// Opaque black, what ClearBackground(BLACK) leaves in the light texture
+void clearLightMask(LightMask *mask)
+{
+    const unsigned char black[4] = {0, 0, 0, 255};
+    uint32_t pixel;
+    memcpy(&pixel, black, sizeof(pixel));
+    for (int row = mask->clipMinY; row < mask->clipMaxY; row++)
+    {
+        uint32_t *pixels = mask->pixels + (size_t)(mask->height - 1 - row) * mask->width;
+        for (int x = mask->clipMinX; x < mask->clipMaxX; x++)
+        {
+            pixels[x] = pixel;
+        }
+    }
+}
+
+// A triangle edge from its top end to its bottom end
+typedef struct MaskEdge
+{
+    float x; // at the top end
+    float y;
+    float endY;
+    float slope; // x per y
+} MaskEdge;
+
+/*
+Ordered by y then x whichever way round it was given, so two triangles sharing an edge
+work out exactly the same x on every row and neither leaves a gap nor covers a pixel twice
+*/
+static MaskEdge makeMaskEdge(Vector2 a, Vector2 b)
+{
+    if (b.y < a.y || (b.y == a.y && b.x < a.x))
+    {
+        Vector2 swap = a;
+        a = b;
+        b = swap;
+    }
+    MaskEdge edge = {a.x, a.y, b.y, 0.0f};
+    if (b.y > a.y)
+        edge.slope = (b.x - a.x) / (b.y - a.y);
+    return edge;
+}
+
+static int clampToInt(float value, int min, int max)
+{
+    // fmaxf/fminf also get rid of NaN
+    return (int)fminf(fmaxf(value, (float)min), (float)max);
+}
+
+/*
+Scanline rasterizer. A pixel is covered when its center is inside the triangle, with the top and left edges
+counting as inside and the bottom and right ones not, so the triangles of a fan never overlap.
+Points are in mask pixels, y down from the top of the screen
+*/
+static void rasterizeTriangle(LightMask *mask, Vector2 a, Vector2 b, Vector2 c, uint32_t color)
+{
+    MaskEdge edges[3] = {makeMaskEdge(a, b), makeMaskEdge(b, c), makeMaskEdge(c, a)};
+    float minY = fminf(a.y, fminf(b.y, c.y));
+    float maxY = fmaxf(a.y, fmaxf(b.y, c.y));
+    int firstRow = clampToInt(ceilf(minY - 0.5f), mask->clipMinY, mask->clipMaxY);
+    int endRow = clampToInt(ceilf(maxY - 0.5f), mask->clipMinY, mask->clipMaxY);
+    for (int row = firstRow; row < endRow; row++)
+    {
+        float y = row + 0.5f;
+        float left = INFINITY;
+        float right = -INFINITY;
+        for (int i = 0; i < 3; i++)
+        {
+            if (y < edges[i].y || y >= edges[i].endY)
+                continue;
+            float x = edges[i].x + (y - edges[i].y) * edges[i].slope;
+            left = fminf(left, x);
+            right = fmaxf(right, x);
+        }
+        if (!(left < right))
+            continue;
+        int start = clampToInt(ceilf(left - 0.5f), mask->clipMinX, mask->clipMaxX);
+        int end = clampToInt(ceilf(right - 0.5f), mask->clipMinX, mask->clipMaxX);
+        if (end > start)
+            spanKernel(mask->pixels + (size_t)(mask->height - 1 - row) * mask->width + start, end - start, color);
+    }
+}
+
+/*
+Add a triangle fan given in world coordinates to the mask, the way drawSightTriangles draws it into the
+light texture under BLEND_ADDITIVE: the color, scaled by its alpha, is added to every pixel it covers
+*/
+void rasterizeSightTriangles(LightMask *mask, SightTriangles *sight, Camera2D camera, Color color)
+{
+    const unsigned char add[4] = {color.r * color.a / 255, color.g * color.a / 255, color.b * color.a / 255, 0};
+    uint32_t pixel;
+    memcpy(&pixel, add, sizeof(pixel));
+    float toMask = 1.0f / mask->scale;
+    // once per fan, GetWorldToScreen2D would build it again for every point
+    Matrix cameraMatrix = GetCameraMatrix2D(camera);
+    for (int i = 0; i < sight->triangleCount; i++)
+    {
+        Vector2 point1 = Vector2Transform(sight->triangles[i].point1, cameraMatrix);
+        Vector2 point2 = Vector2Transform(sight->triangles[i].point2, cameraMatrix);
+        Vector2 point3 = Vector2Transform(sight->triangles[i].point3, cameraMatrix);
+        rasterizeTriangle(mask,
+                          (Vector2){point1.x * toMask, point1.y * toMask},
+                          (Vector2){point2.x * toMask, point2.y * toMask},
+                          (Vector2){point3.x * toMask, point3.y * toMask}, pixel);
+    }
+}
+
+// Copy the pixels to the GPU, making the texture the first time. Filtered, so a reduced mask is smoothed back up
+void uploadLightMask(LightMask *mask)
+{
+    if (mask->texture.id != 0)
+    {
+        UpdateTexture(mask->texture, mask->pixels);
+        return;
+    }
+    Image image = {
+        .data = mask->pixels,
+        .width = mask->width,
+        .height = mask->height,
+        .mipmaps = 1,
+        .format = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8,
+    };
+    mask->texture = LoadTextureFromImage(image);
+    SetTextureFilter(mask->texture, TEXTURE_FILTER_BILINEAR);
+}
+
+// Save the mask as a binary PPM, top row first, to check the lighting without a GPU. Returns false if it can't be written
+bool writeLightMask(LightMask *mask, const char *path)
+{
+    FILE *file = fopen(path, "wb");
+    if (file == NULL)
+        return false;
+    fprintf(file, "P6\n%d %d\n255\n", mask->width, mask->height);
+    for (int row = mask->height - 1; row >= 0; row--)
+    {
+        const unsigned char *bytes = (const unsigned char *)(mask->pixels + (size_t)row * mask->width);
+        for (int x = 0; x < mask->width; x++)
+        {
+            fwrite(bytes + x * 4, 1, 3, file);
+        }
+    }
+    return fclose(file) == 0;
+}
@@ -0,0 +1,38 @@
+#ifndef LIGHT_MASK_H_
+#define LIGHT_MASK_H_
+
+#include "raylib.h"
+#include "game_state.h"
+#include <stdint.h>
+
+// Structs
+
+/*
+The light texture drawn on the CPU instead, for machines without a GPU (headless) or with a slow one.
+Sight triangles are rasterized into RGBA pixels, adding their color like BLEND_ADDITIVE, then uploaded in one go.
+Rows are stored bottom up, the same way round as a render texture, so the spotlight shader can sample either
+*/
+typedef struct LightMask
+{
+    uint32_t *pixels; // RGBA8, row 0 is the bottom of the screen
+    int width;
+    int height;
+    int scale;         // screen pixels per mask pixel, each way. 1 is full resolution
+    int clipMinX;      // only pixels in [clipMin, clipMax) are cleared and drawn, see setLightMaskClip
+    int clipMinY;      // (in mask pixels, y down from the top like the screen)
+    int clipMaxX;
+    int clipMaxY;
+    Texture2D texture; // made by the first uploadLightMask, id 0 until then
+} LightMask;
+
+// Functions
+void initLightMask(LightMask *mask, int screenWidth, int screenHeight, int scale);
+void freeLightMask(LightMask *mask);
+void setLightMaskClip(LightMask *mask, int x, int y, int width, int height);
+void clearLightMask(LightMask *mask);
+void rasterizeSightTriangles(LightMask *mask, SightTriangles *sight, Camera2D camera, Color color);
+void uploadLightMask(LightMask *mask);
+bool writeLightMask(LightMask *mask, const char *path);
+const char *getLightMaskKernelName(void);
+
+#endif
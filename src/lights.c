@@ -0,0 +1,277 @@
+#include "raylib.h"
+#include "lights.h"
+#include "game_state.h"
+#include "ray_casting.h"
+#include "edge_buffer.h"
+#include "frame_arena.h"
+#include "camera.h"
+#include "chunks.h"
+#include "world.h"
+#include "profiler.h"
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+
+// most worker threads the pool will start, whatever the core count
+#define MAX_LIGHT_WORKERS 16
+
+/*
+Fixed size pool of worker threads that calculate the visibility polygons of every light.
+Work is handed out one light at a time. Every worker has its own arena, and writes only into the
+sight of the light it picked, so the edges and the rest of the game state can be shared read only.
+*/
+// Argument for each worker thread
+typedef struct LightWorkerArgs
+{
+    struct LightWorkers *workers;
+    int index;
+} LightWorkerArgs;
+
+typedef struct LightWorkers
+{
+    pthread_t threads[MAX_LIGHT_WORKERS];
+    LightWorkerArgs threadArgs[MAX_LIGHT_WORKERS];
+    FrameArena arenas[MAX_LIGHT_WORKERS];
+    VisibilityCacheStats stats[MAX_LIGHT_WORKERS + 1]; // per worker, plus one for the main thread
+    int workerCount;
+    pthread_mutex_t mutex;
+    pthread_cond_t startCondition; // a new batch is ready, or the pool is shutting down
+    pthread_cond_t doneCondition;  // the last light of the batch is finished
+    unsigned int batch;            // bumped for every startLightVisibility
+    int lightCount;                // lights in the current batch
+    int nextLight;                 // next light to hand out
+    int finishedLights;            // lights finished in the current batch
+    bool running;                  // a batch was started and not waited for yet
+    bool quit;
+    GameState *game;
+} LightWorkers;
+
+static void calculateLight(GameState *game, Light *light, FrameArena *arena, VisibilityCacheStats *stats)
+{
+    if (!light->stale)
+        return;
+    calculateSightTrianglesInto(&light->sight, light->position, light->edges, light->edgeCount, light->range, game, arena, stats);
+}
+
+// Calculate lights from the current batch until none are left. Called with the mutex locked
+static void runLightJobs(LightWorkers *workers, FrameArena *arena, VisibilityCacheStats *stats)
+{
+    GameState *game = workers->game;
+    while (workers->nextLight < workers->lightCount)
+    {
+        Light *light = &game->lights[workers->nextLight];
+        workers->nextLight++;
+
+        pthread_mutex_unlock(&workers->mutex);
+        calculateLight(game, light, arena, stats);
+        pthread_mutex_lock(&workers->mutex);
+
+        workers->finishedLights++;
+        if (workers->finishedLights == workers->lightCount)
+            pthread_cond_broadcast(&workers->doneCondition);
+    }
+}
+
+static void *lightWorkerMain(void *arg)
+{
+    LightWorkerArgs *args = (LightWorkerArgs *)arg;
+    LightWorkers *workers = args->workers;
+    unsigned int seenBatch = 0;
+    PROFILE_THREAD_NAME("light worker");
+
+    pthread_mutex_lock(&workers->mutex);
+    while (true)
+    {
+        while (!workers->quit && workers->batch == seenBatch)
+            pthread_cond_wait(&workers->startCondition, &workers->mutex);
+        if (workers->quit)
+            break;
+        seenBatch = workers->batch;
+        resetFrameArena(&workers->arenas[args->index]);
+        runLightJobs(workers, &workers->arenas[args->index], &workers->stats[args->index]);
+    }
+    pthread_mutex_unlock(&workers->mutex);
+    return NULL;
+}
+
+/*
+Start the light worker pool. workerCount <= 0 picks one less than the number of cores,
+since the main thread helps out while it waits. With no workers, lights are calculated on the main thread
+*/
+void initLights(GameState *game, int workerCount)
+{
+    LightWorkers *workers = calloc(1, sizeof(LightWorkers));
+    game->lightWorkers = workers;
+    workers->game = game;
+    pthread_mutex_init(&workers->mutex, NULL);
+    pthread_cond_init(&workers->startCondition, NULL);
+    pthread_cond_init(&workers->doneCondition, NULL);
+
+    if (workerCount <= 0)
+    {
+        workerCount = 3;
+#ifdef _SC_NPROCESSORS_ONLN
+        workerCount = (int)sysconf(_SC_NPROCESSORS_ONLN) - 1;
+#endif
+    }
+    if (workerCount > MAX_LIGHT_WORKERS)
+        workerCount = MAX_LIGHT_WORKERS;
+
+    // pick the SIMD kernel now, before any worker can race to do it
+    getRayKernelName();
+
+    for (int i = 0; i < workerCount; i++)
+    {
+        initFrameArena(&workers->arenas[i], 64 * 1024);
+        workers->threadArgs[i] = (LightWorkerArgs){workers, i};
+        if (pthread_create(&workers->threads[i], NULL, lightWorkerMain, &workers->threadArgs[i]) != 0)
+        {
+            // no threads on this platform (or out of them), make do with what started
+            freeFrameArena(&workers->arenas[i]);
+            break;
+        }
+        workers->workerCount++;
+    }
+}
+
+void freeLights(GameState *game)
+{
+    LightWorkers *workers = game->lightWorkers;
+    if (workers != NULL)
+    {
+        waitLightVisibility(game);
+        pthread_mutex_lock(&workers->mutex);
+        workers->quit = true;
+        pthread_cond_broadcast(&workers->startCondition);
+        pthread_mutex_unlock(&workers->mutex);
+        for (int i = 0; i < workers->workerCount; i++)
+        {
+            pthread_join(workers->threads[i], NULL);
+            freeFrameArena(&workers->arenas[i]);
+        }
+        pthread_mutex_destroy(&workers->mutex);
+        pthread_cond_destroy(&workers->startCondition);
+        pthread_cond_destroy(&workers->doneCondition);
+        free(workers);
+        game->lightWorkers = NULL;
+    }
+
+    for (int i = 0; i < game->lightCount; i++)
+    {
+        freeSightTriangles(&game->lights[i].sight);
+        free(game->lights[i].edges);
+    }
+    free(game->lights);
+    game->lights = NULL;
+    game->lightCount = 0;
+    game->lightCapacity = 0;
+}
+
+// Add a light to the registry. Returns its index
+int addLight(GameState *game, Vector2 position, float range, Color color)
+{
+    game->lights = growBuffer(game->frameArena, game->lights, &game->lightCapacity, game->lightCount + 1, sizeof(Light));
+    Light *light = &game->lights[game->lightCount];
+    *light = (Light){0};
+    light->position = position;
+    light->range = range;
+    light->color = color;
+    game->lightCount++;
+    return game->lightCount - 1;
+}
+
+// Remove a light. The last light takes its index
+void removeLight(GameState *game, int lightIndex)
+{
+    if (lightIndex < 0 || lightIndex >= game->lightCount)
+        return;
+    freeSightTriangles(&game->lights[lightIndex].sight);
+    free(game->lights[lightIndex].edges);
+    game->lights[lightIndex] = game->lights[game->lightCount - 1];
+    game->lightCount--;
+}
+
+/*
+Hand every light to the worker pool. The lights, edges and tiles must not change until waitLightVisibility.
+Lights whose cached sight still holds are skipped before their edges are gathered, and if that's all of them
+the workers aren't woken at all
+*/
+void startLightVisibility(GameState *game)
+{
+    LightWorkers *workers = game->lightWorkers;
+    // every light gets the edges in its range before the workers start, since chunks can only be loaded on the main thread
+    Rectangle view = getCameraViewRect(game);
+    int staleCount = 0;
+    for (int i = 0; i < game->lightCount; i++)
+    {
+        Light *light = &game->lights[i];
+        light->onScreen = CheckCollisionCircleRec(light->position, light->range, view);
+        light->stale = light->onScreen && !isVisibilityCached(&light->sight, light->position, light->range, game);
+        if (light->onScreen && !light->stale)
+            game->visibilityCacheStats.hits++;
+        if (!light->stale)
+            continue;
+        staleCount++;
+        if (game->useChunkWorld)
+            light->edgeCount = gatherChunkEdges(game, light->position, light->range, &light->edges, &light->edgeCapacity);
+        else
+            light->edgeCount = gatherRoomEdges(game, light->position, light->range, &light->edges, &light->edgeCapacity);
+    }
+    if (staleCount == 0)
+        return;
+    pthread_mutex_lock(&workers->mutex);
+    workers->lightCount = game->lightCount;
+    workers->nextLight = 0;
+    workers->finishedLights = 0;
+    workers->running = true;
+    workers->batch++;
+    pthread_cond_broadcast(&workers->startCondition);
+    pthread_mutex_unlock(&workers->mutex);
+}
+
+// Help with the lights that are left, then wait for the workers to finish theirs
+void waitLightVisibility(GameState *game)
+{
+    LightWorkers *workers = game->lightWorkers;
+    pthread_mutex_lock(&workers->mutex);
+    if (!workers->running)
+    {
+        pthread_mutex_unlock(&workers->mutex);
+        return;
+    }
+    runLightJobs(workers, game->frameArena, &workers->stats[MAX_LIGHT_WORKERS]);
+    while (workers->finishedLights < workers->lightCount)
+        pthread_cond_wait(&workers->doneCondition, &workers->mutex);
+    workers->running = false;
+
+    // fold the cache stats from every thread into the game's
+    for (int i = 0; i <= MAX_LIGHT_WORKERS; i++)
+    {
+        game->visibilityCacheStats.hits += workers->stats[i].hits;
+        game->visibilityCacheStats.misses += workers->stats[i].misses;
+        workers->stats[i] = (VisibilityCacheStats){0};
+    }
+    pthread_mutex_unlock(&workers->mutex);
+}
+
+// Draw every light's visibility polygon into the current (screen space) target
+void drawLights(GameState *game)
+{
+    for (int i = 0; i < game->lightCount; i++)
+    {
+        if (!game->lights[i].onScreen)
+            continue;
+        drawSightTriangles(&game->lights[i].sight, game->playerCamera->camera, game->lights[i].color);
+    }
+}
+
+// Same as drawLights, into a CPU light mask
+void rasterizeLights(GameState *game, LightMask *mask)
+{
+    for (int i = 0; i < game->lightCount; i++)
+    {
+        if (!game->lights[i].onScreen)
+            continue;
+        rasterizeSightTriangles(mask, &game->lights[i].sight, game->playerCamera->camera, game->lights[i].color);
+    }
+}
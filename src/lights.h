@@ -0,0 +1,34 @@
+#ifndef LIGHTS_H_
+#define LIGHTS_H_
+
+#include "raylib.h"
+#include "game_state.h"
+#include "light_mask.h"
+
+// Structs
+
+// A light source with its own visibility polygon (torch, lantern...)
+typedef struct Light
+{
+    Vector2 position;     // where the light is in the world
+    float range;          // how far the light reaches, in pixels
+    Color color;          // color drawn into the light texture
+    SightTriangles sight; // visibility polygon, written only by the thread computing this light
+    Edge *edges;          // walls in range, gathered on the main thread before the workers start
+    int edgeCount;
+    int edgeCapacity;
+    bool onScreen;        // range touches the camera view this frame. lights off screen aren't calculated or drawn
+    bool stale;           // on screen and its cached sight can't be used, so a worker has to calculate it
+} Light;
+
+// Functions
+void initLights(GameState *game, int workerCount);
+void freeLights(GameState *game);
+int addLight(GameState *game, Vector2 position, float range, Color color);
+void removeLight(GameState *game, int lightIndex);
+void startLightVisibility(GameState *game);
+void waitLightVisibility(GameState *game);
+void drawLights(GameState *game);
+void rasterizeLights(GameState *game, LightMask *mask);
+
+#endif
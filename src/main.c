@@ -8,12 +8,74 @@
 #include "game_state.h"
 #include "world.h"
 #include "ray_casting.h"
+#include "frame_arena.h"
+#include "lights.h"
+#include "chunks.h"
+#include "frame_pipeline.h"
+#include "profiler.h"
+#include "replay.h"
+#include <string.h>
 
-void updateGame(GameState *game);
-void drawGame(GameState *game, RenderTexture2D, RenderTexture2D shadowTexture, RenderTexture2D worldTexture);
+// frames the profiler overlay and traces look back over
+#define PROFILER_OVERLAY_FRAMES 120
+#define PROFILER_TRACE_PATH "profile_trace.json"
 
-int main()
+void readGameInput(GameInput *input);
+void handOverGameInput(GameState *game, GameInput *input, Camera2D shownCamera);
+void drawWorldPass(GameState *game, FramePacket *packet, RenderTexture2D worldTexture);
+void drawLightPass(GameState *game, FramePacket *packet, RenderTexture2D lightTexture, LightMask *lightMask, int lightScale, RenderTexture2D worldTexture);
+void drawProfilerOverlay(int x, int y);
+
+// F3 shows the per stage frame times
+static bool showProfiler = true;
+// F5 switches the light texture between the GPU and the CPU rasterizer (light_mask.h)
+static bool useLightMask = false;
+// what the light texture and the light mask hold, so only what changed since is drawn again
+static LightTextureHistory lightTextureHistory;
+static LightTextureHistory lightMaskHistory;
+
+/*
+Usage: main [-record file.rec] [-replay file.rec] [-frames times.csv] [-cpulight] [-lightscale N]
+-record logs the input of every update, -replay plays a log back instead of the keyboard and mouse
+and closes when it runs out, uncapped, one logged update per frame, printing how long the frames took. -frames saves each frame's time as CSV.
+-cpulight starts with the light texture rasterized on the CPU. -lightscale draws the light texture at 1/N of
+the screen's resolution (2 or 4 save a lot of fill rate at high resolutions), it's smoothed back up when composited
+*/
+int main(int argc, char **argv)
 {
+    const char *recordPath = NULL;
+    const char *replayPath = NULL;
+    const char *framesPath = NULL;
+    int lightScale = 1;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-record") == 0 && i + 1 < argc)
+            recordPath = argv[++i];
+        else if (strcmp(argv[i], "-replay") == 0 && i + 1 < argc)
+            replayPath = argv[++i];
+        else if (strcmp(argv[i], "-frames") == 0 && i + 1 < argc)
+            framesPath = argv[++i];
+        else if (strcmp(argv[i], "-cpulight") == 0)
+            useLightMask = true;
+        else if (strcmp(argv[i], "-lightscale") == 0 && i + 1 < argc)
+        {
+            lightScale = atoi(argv[++i]);
+            if (lightScale < 1)
+                lightScale = 1;
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [-record file.rec] [-replay file.rec] [-frames times.csv] [-cpulight] [-lightscale N]\n", argv[0]);
+            return 1;
+        }
+    }
+    InputLog replay = {0};
+    if (replayPath != NULL && !loadInputLog(&replay, replayPath))
+    {
+        fprintf(stderr, "can't read replay %s\n", replayPath);
+        return 1;
+    }
+
     // Initialization
     //--------------------------------------------------------------------------------------
     // window and game init
@@ -26,6 +88,24 @@ int main()
     InitGame(&game);
 
     SetTargetFPS(144); // Set our game to run at 60 frames-per-second
+    if (replayPath != NULL)
+    {
+        // the screen size decides the sight range, so a replay at another size won't end up the same
+        if (replay.screenWidth != screenWidth || replay.screenHeight != screenHeight)
+            TraceLog(LOG_WARNING, "replay: recorded at %dx%d, playing at %dx%d", replay.screenWidth, replay.screenHeight, screenWidth, screenHeight);
+        game.inputReplay = &replay;
+        // as fast as it goes, for timing
+        SetTargetFPS(0);
+    }
+    InputRecorder recorder = {0};
+    if (recordPath != NULL)
+    {
+        if (startInputRecording(&recorder, recordPath, &game))
+            game.inputRecorder = &recorder;
+        else
+            TraceLog(LOG_WARNING, "replay: can't create %s", recordPath);
+    }
+    FrameTimes frameTimes = {0};
     // shaders
     Shader spotlightShader = LoadShader(0, "resources/shaders/spotlight.fs");
     float lightPosLoc = GetShaderLocation(spotlightShader, "lightPos");
@@ -34,98 +114,172 @@ int main()
     int resolutionLoc = GetShaderLocation(spotlightShader, "resolution");
     Vector2 resolution = {(float)screenWidth, (float)screenHeight};
     SetShaderValue(spotlightShader, resolutionLoc, &resolution, SHADER_UNIFORM_VEC2);
-    // white is light, black is dark
-    RenderTexture2D lightTexture = LoadRenderTexture(game.screenWidth, game.screenHeight);
-    RenderTexture2D shadowTexture = LoadRenderTexture(game.screenWidth, game.screenHeight);
+    // white is light, black is dark. 1/lightScale of the screen, rounded up, and filtered to smooth it back up
+    RenderTexture2D lightTexture = LoadRenderTexture((game.screenWidth + lightScale - 1) / lightScale, (game.screenHeight + lightScale - 1) / lightScale);
     RenderTexture2D worldTexture = LoadRenderTexture(game.screenWidth, game.screenHeight);
     SetTextureFilter(lightTexture.texture, TEXTURE_FILTER_BILINEAR);
+    LightMask lightMask;
+    initLightMask(&lightMask, game.screenWidth, game.screenHeight, lightScale);
     game.spotlightShader = spotlightShader;
     //--------------------------------------------------------------------------------------
 
+    PROFILE_THREAD_NAME("main");
+    // input read since the last hand over, and the camera the frame on screen was drawn with
+    GameInput input = {0};
+    Camera2D shownCamera = game.playerCamera->camera;
+    // updates and visibility run on their own thread, a frame ahead of drawing
+    FramePipeline pipeline;
+    startFramePipeline(&pipeline, &game);
+
     // Main game loop
     while (!WindowShouldClose()) // Detect window close button or ESC key
     {
-        // Update
-        updateGame(&game);
+        PROFILE_FRAME();
+        uint64_t frameStart = profilerNow();
+        if (IsKeyPressed(KEY_F3))
+            showProfiler = !showProfiler;
+        // F4 saves the last frames for chrome://tracing or ui.perfetto.dev
+        if (IsKeyPressed(KEY_F4))
+        {
+            if (writeProfilerTrace(PROFILER_TRACE_PATH, PROFILER_OVERLAY_FRAMES))
+                TraceLog(LOG_INFO, "profiler: trace written to %s", PROFILER_TRACE_PATH);
+            else
+                TraceLog(LOG_WARNING, "profiler: can't write %s", PROFILER_TRACE_PATH);
+        }
+        if (IsKeyPressed(KEY_F5))
+        {
+            useLightMask = !useLightMask;
+            TraceLog(LOG_INFO, "lights: drawn on the %s", useLightMask ? getLightMaskKernelName() : "GPU");
+        }
+        readGameInput(&input);
+        // the game state is ours until the pipeline is resumed
+        FramePacket *packet = waitFramePacket(&pipeline);
+        // this packet is the replay's last
+        if (replayPath != NULL && isInputLogFinished(&replay))
+            break;
+        if (replayPath == NULL)
+            handOverGameInput(&game, &input, shownCamera);
+        // F6 steps through the visibility algorithms and ray casters, while the game state is ours
+        if (IsKeyPressed(KEY_F6))
+        {
+            cycleVisibilityMode(&game);
+            if (game.visibilityAlgorithm == VISIBILITY_ANGULAR_SWEEP)
+                TraceLog(LOG_INFO, "visibility: angular sweep");
+            else
+                TraceLog(LOG_INFO, "visibility: ray fan, %s rays", getRayCastModeName(game.rayCastMode));
+        }
+        shownCamera = packet->camera.camera;
         // draw light at player's feet
-        Vector2 playerFeetPos = {game.player->playerPos.x + game.player->playerSize.x / 2, game.player->playerPos.y + game.player->playerSize.y};
-        Vector2 playerScreenPos = GetWorldToScreen2D(playerFeetPos, game.playerCamera->camera);
+        Vector2 playerFeetPos = {packet->player.playerPos.x + packet->player.playerSize.x / 2, packet->player.playerPos.y + packet->player.playerSize.y};
+        Vector2 playerScreenPos = GetWorldToScreen2D(playerFeetPos, packet->camera.camera);
         SetShaderValue(spotlightShader, lightPosLoc, &playerScreenPos, SHADER_UNIFORM_VEC2);
         float t = GetTime();
         SetShaderValue(spotlightShader, GetShaderLocation(spotlightShader, "time"), &t, SHADER_UNIFORM_FLOAT);
         // Draw
-        drawGame(&game, lightTexture, shadowTexture, worldTexture);
+        // the world pass reads the tiles, so it's drawn before the next frame's updates can change them
+        drawWorldPass(&game, packet, worldTexture);
+        // a replay steps one logged update per frame, so every run draws and times the same frames whatever the clock says
+        resumeFramePipeline(&pipeline, replayPath != NULL ? SIMULATION_STEP : GetFrameTime());
+        // the rest only needs the packet, and overlaps the next frame's update and visibility
+        drawLightPass(&game, packet, lightTexture, useLightMask ? &lightMask : NULL, lightScale, worldTexture);
+        addFrameTime(&frameTimes, (profilerNow() - frameStart) / 1e6);
     }
 
+    // the simulation thread has to be done with the game before it's freed
+    waitFramePacket(&pipeline);
+    stopFramePipeline(&pipeline);
+    // only for runs being measured, a normal session doesn't need the summary
+    if (replayPath != NULL || framesPath != NULL)
+        printFrameTimes(&frameTimes, stdout);
+    if (framesPath != NULL && !writeFrameTimes(&frameTimes, framesPath))
+        TraceLog(LOG_WARNING, "replay: can't write %s", framesPath);
+    stopInputRecording(&recorder);
+    freeInputLog(&replay);
+    freeFrameTimes(&frameTimes);
+
     // De-Initialization
-    CloseWindow(); // Close window and OpenGL context
+    // textures have to be unloaded while the OpenGL context is still around
     FreeGame(&game);
     UnloadRenderTexture(lightTexture);
-    UnloadRenderTexture(shadowTexture);
+    freeLightMask(&lightMask);
+    freeLightTextureHistory(&lightTextureHistory);
+    freeLightTextureHistory(&lightMaskHistory);
     UnloadRenderTexture(worldTexture);
+    CloseWindow(); // Close window and OpenGL context
 
     return 0;
 }
 
-void updateGame(GameState *game)
+/*
+Fill in the input from the keyboard and mouse.
+Frames and updates don't line up, so presses are kept until handed over to the simulation (handOverGameInput),
+and the mouse stays where it was clicked until then
+*/
+void readGameInput(GameInput *input)
 {
-    // get time since last frame
-    game->deltaTime = GetFrameTime();
-
-    // Handle tile clicking
-    if (IsMouseButtonPressed(MOUSE_BUTTON_LEFT))
-    {
-        Vector2 mousePos = GetMousePosition();
-        Vector2 mousePosInWorld = GetScreenToWorld2D(mousePos, game->playerCamera->camera);
-
-        // Convert world position to tile coordinates
-        int tileX = (int)(mousePosInWorld.x / game->tileSize);
-        int tileY = (int)(mousePosInWorld.y / game->tileSize);
-
-        // Check if tile coordinates are valid
-        if (tileX >= 0 && tileX < game->roomWidth &&
-            tileY >= 0 && tileY < game->roomHeight)
-        {
-            Tile *clickedTile = &GET_TILE(game, tileX, tileY);
-
-            // Toggle between floor and wall
-            if (clickedTile->tileType == TILE_FLOOR)
-                clickedTile->tileType = TILE_WALL;
-            else if (clickedTile->tileType == TILE_WALL)
-                clickedTile->tileType = TILE_FLOOR;
-            roomTilesToRoomLines(game);
-        }
-    }
-
-    updatePlayer(game);
-    // update camera
-    updateCamera(game);
+    input->moveUp = IsKeyDown(KEY_W);
+    input->moveDown = IsKeyDown(KEY_S);
+    input->moveLeft = IsKeyDown(KEY_A);
+    input->moveRight = IsKeyDown(KEY_D);
+    if (!input->editTile && !input->placeLight)
+        input->mousePosition = GetMousePosition();
+    input->toggleWorld |= IsKeyPressed(KEY_F2);
+    input->editTile |= IsMouseButtonPressed(MOUSE_BUTTON_LEFT);
+    input->placeLight |= IsMouseButtonPressed(MOUSE_BUTTON_RIGHT);
 }
 
-void drawGame(GameState *game, RenderTexture2D lightTexture, RenderTexture2D shadowTexture, RenderTexture2D worldTexture)
+/*
+Pass the input on to the game, for the simulation thread's next updates. Presses it hasn't acted on yet are kept.
+Clicks were aimed at the frame on screen, drawn with shownCamera, while the game's camera has moved on since,
+so the mouse is moved to where the clicked spot of the world is now
+*/
+void handOverGameInput(GameState *game, GameInput *input, Camera2D shownCamera)
 {
+    GameInput *gameInput = &game->input;
+    gameInput->moveUp = input->moveUp;
+    gameInput->moveDown = input->moveDown;
+    gameInput->moveLeft = input->moveLeft;
+    gameInput->moveRight = input->moveRight;
+    Vector2 mouseInWorld = GetScreenToWorld2D(input->mousePosition, shownCamera);
+    gameInput->mousePosition = GetWorldToScreen2D(mouseInWorld, game->playerCamera->camera);
+    gameInput->toggleWorld |= input->toggleWorld;
+    gameInput->editTile |= input->editTile;
+    gameInput->placeLight |= input->placeLight;
+    clearGameInputClicks(input);
+}
 
-    // Calculate and draw sight polygon
-    Triangle *sight = calculatePlayerSight(game, game->screenWidth); // 300 pixel sight range
+// Tiles and player into worldTexture. Needs the game state, so only between waitFramePacket and resumeFramePipeline
+void drawWorldPass(GameState *game, FramePacket *packet, RenderTexture2D worldTexture)
+{
+    // drawn where the packet has them, the game's own player and camera are the simulated ones
+    Player simulatedPlayer = *game->player;
+    PlayerCamera simulatedCamera = *game->playerCamera;
+    *game->player = packet->player;
+    *game->playerCamera = packet->camera;
 
-    BeginTextureMode(shadowTexture);
-    DrawRectangle(0, 0, game->screenWidth, game->screenHeight, BLACK);
-    EndTextureMode();
-    // Make sure your lightTexture is the same size as your screen
-    BeginTextureMode(lightTexture);
-    // After creating the render texture, set filtering mode
-    ClearBackground(BLACK);
-    // draw white triangles every where the light can touch
-    drawSightPolygon(game, ColorAlpha(YELLOW, 0.3f));
-    // exclude the player from the light polygon for now
-    // Vector2 playerScreenPos = GetWorldToScreen2D(game->player->playerPos, game->playerCamera->camera);
-    // DrawRectangle(playerScreenPos.x, playerScreenPos.y, game->player->playerSize.x, game->player->playerSize.y, WHITE);
-    EndTextureMode();
+    PROFILE_BEGIN(bakeTileLayers);
+    // tiles changed since last frame are drawn into the tile layers, before the world pass starts its own texture mode
+    if (!isTileRegionEmpty(packet->dirtyTiles))
+    {
+        growTileRegion(&game->roomTileLayerDirty, packet->dirtyTiles.minX, packet->dirtyTiles.minY);
+        growTileRegion(&game->roomTileLayerDirty, packet->dirtyTiles.maxX, packet->dirtyTiles.maxY);
+    }
+    if (packet->useChunkWorld)
+        bakeChunkTileLayers(game);
+    else
+        bakeRoomTileLayer(game);
+    // chunks evicted while in the room still hold a texture
+    unloadReleasedTileLayers(game->chunkWorld);
+    PROFILE_END(bakeTileLayers);
 
+    PROFILE_BEGIN(worldPass);
     BeginTextureMode(worldTexture);
     BeginMode2D(game->playerCamera->camera);
     ClearBackground(BLACK);
-    drawRoomTiles(game);
+    if (packet->useChunkWorld)
+        drawChunkWorld(game);
+    else
+        drawRoomTiles(game);
 
     // draw edge visualizations
     // for (int i = 0; i < game->roomEdgeCount; i++)
@@ -140,8 +294,57 @@ void drawGame(GameState *game, RenderTexture2D lightTexture, RenderTexture2D sha
     DrawRectangle(game->player->playerPos.x, game->player->playerPos.y, game->player->playerSize.x, game->player->playerSize.y, WHITE);
     EndMode2D();
     EndTextureMode();
+    PROFILE_END(worldPass);
+
+    *game->player = simulatedPlayer;
+    *game->playerCamera = simulatedCamera;
+}
+
+/*
+Light pass, compositing and UI. Only reads the packet (and the shader), so it runs alongside the simulation thread.
+The light texture is drawn into lightTexture on the GPU, or rasterized into lightMask on the CPU if it isn't NULL,
+either way at 1/lightScale of the screen's resolution. Only the part that changed since the last frame
+is drawn again, and nothing is when the camera, the player's sight and the lights stayed the same
+*/
+void drawLightPass(GameState *game, FramePacket *packet, RenderTexture2D lightTexture, LightMask *lightMask, int lightScale, RenderTexture2D worldTexture)
+{
+    PROFILE_BEGIN(lightPass);
+    Texture2D light = lightTexture.texture;
+    Rectangle region;
+    if (lightMask != NULL)
+    {
+        if (getLightTextureChanges(&lightMaskHistory, packet, lightScale, lightMask->width, lightMask->height, &region))
+        {
+            setLightMaskClip(lightMask, region.x, region.y, region.width, region.height);
+            rasterizePacketLightMask(packet, lightMask);
+            uploadLightMask(lightMask);
+        }
+        light = lightMask->texture;
+    }
+    else if (getLightTextureChanges(&lightTextureHistory, packet, lightScale, lightTexture.texture.width, lightTexture.texture.height, &region))
+    {
+        // lightTexture is smaller than the screen when lightScale > 1, the packet's camera is scaled to match
+        BeginTextureMode(lightTexture);
+        // the rest still holds what was drawn before
+        BeginScissorMode(region.x, region.y, region.width, region.height);
+        // After creating the render texture, set filtering mode
+        ClearBackground(BLACK);
+        // draw white triangles every where the light can touch
+        drawPacketSight(packet, WHITE, lightScale);
+        // other lights add their color on top
+        BeginBlendMode(BLEND_ADDITIVE);
+        drawPacketLights(packet, lightScale);
+        EndBlendMode();
+        // exclude the player from the light polygon for now
+        // Vector2 playerScreenPos = GetWorldToScreen2D(game->player->playerPos, game->playerCamera->camera);
+        // DrawRectangle(playerScreenPos.x, playerScreenPos.y, game->player->playerSize.x, game->player->playerSize.y, WHITE);
+        EndScissorMode();
+        EndTextureMode();
+    }
+    PROFILE_END(lightPass);
 
     // draw texture to screen
+    PROFILE_BEGIN(compositePass);
     BeginDrawing();
     ClearBackground(BLACK);
     Rectangle source = {0, 0, (float)worldTexture.texture.width, -(float)worldTexture.texture.height};
@@ -149,9 +352,12 @@ void drawGame(GameState *game, RenderTexture2D lightTexture, RenderTexture2D sha
     DrawTexturePro(worldTexture.texture, source, dest, (Vector2){0, 0}, 0.0f, WHITE);
 
     BeginShaderMode(game->spotlightShader);
-    SetShaderValueTexture(game->spotlightShader, GetShaderLocation(game->spotlightShader, "lightTexture"), lightTexture.texture);
-    // DrawRectangle(0, 0, game->screenWidth, game->screenHeight, WHITE);
-    DrawTexture(shadowTexture.texture, 0, 0, BLACK);
+    SetShaderValueTexture(game->spotlightShader, GetShaderLocation(game->spotlightShader, "lightTexture"), light);
+    // one quad over the screen, straight from the light texture. the shader does the rest.
+    // only the part the screen covers, the texture was rounded up
+    Rectangle lightSource = {0, 0, (float)game->screenWidth / lightScale, (float)game->screenHeight / lightScale};
+    Rectangle screen = {0, 0, (float)game->screenWidth, (float)game->screenHeight};
+    DrawTexturePro(light, lightSource, screen, (Vector2){0, 0}, 0.0f, BLACK);
     EndShaderMode();
 
     // draw ui
@@ -159,8 +365,37 @@ void drawGame(GameState *game, RenderTexture2D lightTexture, RenderTexture2D sha
     DrawText("This is a raylib example", 10, 40, 20, DARKGRAY);
 
     DrawFPS(10, 10);
+    // frame arena counters, for the previous frame. mallocs should stay at 0 unless the map changes
+    FrameArenaStats arenaStats = packet->arenaStats;
+    DrawText(TextFormat("arena: %d allocs, %d KB, %d mallocs", arenaStats.allocations, (int)(arenaStats.bytes / 1024), arenaStats.systemAllocations), 10, 70, 20, DARKGRAY);
+    DrawText(TextFormat("visibility cache: %d hits, %d misses", packet->visibilityCacheStats.hits, packet->visibilityCacheStats.misses), 10, 100, 20, DARKGRAY);
+    if (packet->useChunkWorld)
+        DrawText(TextFormat("chunks: %d loaded, %d KB", packet->chunkCount, (int)(packet->chunkMemory / 1024)), 10, 130, 20, DARKGRAY);
     // snprintf(testString, 50, "Player Velocity:\n\t%f\n\t%f", game.player->playerVelocity.x, game.player->playerVelocity.y);
     // DrawText(testString, 10, 60, 20, DARKGRAY);
+    if (showProfiler)
+        drawProfilerOverlay(10, 160);
+    PROFILE_END(compositePass);
 
+    // includes waiting for the frame rate limit
+    PROFILE_SCOPE(endDrawing)
     EndDrawing();
-}
\ No newline at end of file
+}
+
+// Average and 99th percentile time of every profiled stage, over the last frames
+void drawProfilerOverlay(int x, int y)
+{
+    ProfileStageStats stats[PROFILER_MAX_STAGES];
+    int stageCount = getProfilerStageStats(stats, PROFILER_MAX_STAGES, PROFILER_OVERLAY_FRAMES);
+    // the default font isn't monospaced, so columns go at fixed offsets
+    DrawText("ms per frame. F3 hides, F4 saves a trace", x, y, 10, DARKGRAY);
+    DrawText("avg", x + 170, y + 12, 10, DARKGRAY);
+    DrawText("p99", x + 220, y + 12, 10, DARKGRAY);
+    for (int i = 0; i < stageCount; i++)
+    {
+        int rowY = y + 12 * (i + 2);
+        DrawText(stats[i].name, x, rowY, 10, DARKGRAY);
+        DrawText(TextFormat("%.2f", stats[i].averageMs), x + 170, rowY, 10, DARKGRAY);
+        DrawText(TextFormat("%.2f", stats[i].p99Ms), x + 220, rowY, 10, DARKGRAY);
+    }
+}
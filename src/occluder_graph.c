@@ -0,0 +1,117 @@
+#include "raylib.h"
+#include "occluder_graph.h"
+#include "world.h"
+#include "frame_arena.h"
+#include <stdint.h>
+#include <string.h>
+
+static uint32_t hashOccluderPosition(Vector2 position)
+{
+    // + 0.0f turns -0 into 0, so both hash the same
+    float x = position.x + 0.0f;
+    float y = position.y + 0.0f;
+    uint32_t bitsX;
+    uint32_t bitsY;
+    memcpy(&bitsX, &x, sizeof(bitsX));
+    memcpy(&bitsY, &y, sizeof(bitsY));
+    uint32_t hash = bitsX * 0x9E3779B1u ^ bitsY * 0x85EBCA77u;
+    return hash ^ (hash >> 15);
+}
+
+// Add an edge that ends at position, going off in direction, to the vertex there
+static void addOccluderVertexEdge(OccluderGraph *graph, Vector2 position, Vector2 direction)
+{
+    int slot = hashOccluderPosition(position) & (graph->slotCount - 1);
+    while (graph->slots[slot] != -1)
+    {
+        OccluderVertex *vertex = &graph->vertices[graph->slots[slot]];
+        if (vertex->position.x == position.x && vertex->position.y == position.y)
+        {
+            if (vertex->edgeCount < MAX_OCCLUDER_VERTEX_EDGES)
+                vertex->directions[vertex->edgeCount] = direction;
+            vertex->edgeCount++;
+            return;
+        }
+        slot = (slot + 1) & (graph->slotCount - 1);
+    }
+
+    graph->slots[slot] = graph->vertexCount;
+    OccluderVertex *vertex = &graph->vertices[graph->vertexCount];
+    graph->vertexCount++;
+    vertex->position = position;
+    vertex->directions[0] = direction;
+    vertex->edgeCount = 1;
+}
+
+static OccluderVertexKind classifyOccluderVertex(OccluderVertex *vertex)
+{
+    if (vertex->edgeCount != 2)
+        return OCCLUDER_OPEN;
+    Vector2 a = vertex->directions[0];
+    Vector2 b = vertex->directions[1];
+    float cross = a.x * b.y - a.y * b.x;
+    float dot = a.x * b.x + a.y * b.y;
+    if (cross == 0)
+        return dot < 0 ? OCCLUDER_STRAIGHT : OCCLUDER_OPEN;
+    return OCCLUDER_CORNER;
+}
+
+/*
+Merge the endpoints of the edges into vertices, recording the edges that meet at each.
+Two merged edges sharing a corner then give one vertex instead of two endpoints.
+Everything is allocated from the arena, so the graph lives as long as the caller's arena mark.
+*/
+void buildOccluderGraph(OccluderGraph *graph, Edge *edges, int edgeCount, FrameArena *arena)
+{
+    // at most two vertices per edge, and the hash map is kept at most half full
+    int slotCount = 16;
+    while (slotCount < edgeCount * 4)
+        slotCount *= 2;
+    graph->vertices = arenaAlloc(arena, (edgeCount * 2 + 1) * sizeof(OccluderVertex));
+    graph->vertexCount = 0;
+    graph->slots = arenaAlloc(arena, slotCount * sizeof(int));
+    graph->slotCount = slotCount;
+    memset(graph->slots, 0xff, slotCount * sizeof(int));
+
+    for (int i = 0; i < edgeCount; i++)
+    {
+        // slots freed by worldSetTile
+        if (!edges[i].visited)
+            continue;
+        Vector2 along = {edges[i].end.x - edges[i].start.x, edges[i].end.y - edges[i].start.y};
+        addOccluderVertexEdge(graph, edges[i].start, along);
+        addOccluderVertexEdge(graph, edges[i].end, (Vector2){-along.x, -along.y});
+    }
+
+    for (int i = 0; i < graph->vertexCount; i++)
+    {
+        graph->vertices[i].kind = classifyOccluderVertex(&graph->vertices[i]);
+    }
+}
+
+/*
+How many rays a vertex needs seen from origin.
+A corner with both edges on the same side of the ray could be a silhouette, so the ray may slip past it and
+carry on: 3 rays, one at the corner and one just to each side. With the edges on either side of the ray
+(every concave corner, and a convex one seen from its tip) the ray stops at the corner and 1 ray is enough.
+Straight vertices never bend the visibility polygon and need none.
+*/
+int getOccluderVertexRayCount(OccluderVertex *vertex, Vector2 origin)
+{
+    switch (vertex->kind)
+    {
+    case OCCLUDER_STRAIGHT:
+        return 0;
+    case OCCLUDER_CORNER:
+    {
+        Vector2 toVertex = {vertex->position.x - origin.x, vertex->position.y - origin.y};
+        float side0 = toVertex.x * vertex->directions[0].y - toVertex.y * vertex->directions[0].x;
+        float side1 = toVertex.x * vertex->directions[1].y - toVertex.y * vertex->directions[1].x;
+        if (side0 == 0 || side1 == 0 || (side0 > 0) == (side1 > 0))
+            return 3;
+        return 1;
+    }
+    default:
+        return 3;
+    }
+}
@@ -0,0 +1,42 @@
+#ifndef OCCLUDER_GRAPH_H_
+#define OCCLUDER_GRAPH_H_
+
+#include "raylib.h"
+#include "game_state.h"
+
+// most edges that can end at one vertex of the tile grid (two corners touching diagonally)
+#define MAX_OCCLUDER_VERTEX_EDGES 4
+
+// Structs
+
+// What a vertex looks like, whichever side it is seen from
+typedef enum OccluderVertexKind
+{
+    OCCLUDER_STRAIGHT, // two edges in a line (a wall split at a chunk border). never a corner of the visibility polygon
+    OCCLUDER_CORNER,   // two edges at an angle. convex or concave, depending on which side it is seen from
+    OCCLUDER_OPEN      // one edge (the other was left out of the edge list), or corners touching diagonally
+} OccluderVertexKind;
+
+// An edge endpoint, shared by every edge ending there
+typedef struct OccluderVertex
+{
+    Vector2 position;
+    Vector2 directions[MAX_OCCLUDER_VERTEX_EDGES]; // from the vertex along each edge ending there, not normalized
+    int edgeCount;
+    OccluderVertexKind kind;
+} OccluderVertex;
+
+// Edge endpoints with duplicates merged, and what meets at each of them
+typedef struct OccluderGraph
+{
+    OccluderVertex *vertices;
+    int vertexCount;
+    int *slots;    // hash map from position to vertex index, -1 for empty slots
+    int slotCount; // power of 2
+} OccluderGraph;
+
+// Functions
+void buildOccluderGraph(OccluderGraph *graph, Edge *edges, int edgeCount, FrameArena *arena);
+int getOccluderVertexRayCount(OccluderVertex *vertex, Vector2 origin);
+
+#endif
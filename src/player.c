@@ -4,26 +4,26 @@
 #include "game_state.h"
 
 /*
- * Reads keypresses for player direction. Normalizes the vector before returning
+ * Reads the movement keys from the frame's input for player direction. Normalizes the vector before returning
  */
-Vector2 getPlayerDirection()
+Vector2 getPlayerDirection(GameInput *input)
 {
     Vector2 direction = (Vector2){0.0f, 0.0f};
     //----------------------------------------------------------------------------------
     // keybinds
-    if (IsKeyDown(KEY_D))
+    if (input->moveRight)
     {
         direction.x = 1;
     }
-    if (IsKeyDown(KEY_A))
+    if (input->moveLeft)
     {
         direction.x = -1;
     }
-    if (IsKeyDown(KEY_W))
+    if (input->moveUp)
     {
         direction.y = -1;
     }
-    if (IsKeyDown(KEY_S))
+    if (input->moveDown)
     {
         direction.y = 1;
     }
@@ -44,13 +44,13 @@ void updatePlayer(GameState *game)
     // reset player's target velocity
     game->player->playerTargetVelocity = (Vector2){0.0f, 0.0f};
     // read keypresses for player direction
-    Vector2 direction = getPlayerDirection();
+    Vector2 direction = getPlayerDirection(&game->input);
 
     // update the player's target velocity
     game->player->playerTargetVelocity.x = game->player->playerSpeed * direction.x;
     game->player->playerTargetVelocity.y = game->player->playerSpeed * direction.y;
 
-    // lerp the player's actual velocity towards the target velocity
+    // lerp the player's actual velocity towards the target velocity. once per fixed step, so the feel doesn't depend on the frame rate
     float playerAccelTime = 0.09f;
     game->player->playerVelocity.x = Lerp(game->player->playerVelocity.x, game->player->playerTargetVelocity.x, playerAccelTime);
     game->player->playerVelocity.y = Lerp(game->player->playerVelocity.y, game->player->playerTargetVelocity.y, playerAccelTime);
@@ -15,7 +15,7 @@ typedef struct Player
 } Player;
 
 // Functions
-Vector2 getPlayerDirection();
+Vector2 getPlayerDirection(GameInput *input);
 void updatePlayer(GameState *game);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,279 @@
+#include "profiler.h"
+#include "stats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#if defined(__GNUC__)
+#define PROFILER_THREAD_LOCAL __thread
+#define storeRelaxed(x, value) __atomic_store_n(&(x), value, __ATOMIC_RELAXED)
+#define loadAcquire(x) __atomic_load_n(&(x), __ATOMIC_ACQUIRE)
+#define storeRelease(x, value) __atomic_store_n(&(x), value, __ATOMIC_RELEASE)
+#else
+// plain accesses, good enough on x86
+#define PROFILER_THREAD_LOCAL __declspec(thread)
+#define storeRelaxed(x, value) ((x) = (value))
+#define loadAcquire(x) (x)
+#define storeRelease(x, value) ((x) = (value))
+#endif
+
+typedef struct ProfileEvent
+{
+    const char *name;
+    uint64_t start; // profilerNow
+    uint64_t end;
+} ProfileEvent;
+
+/*
+One thread's events. Only the owning thread writes, anyone can read: readers copy what they need,
+then check head again and throw away whatever the writer could have overwritten meanwhile
+*/
+typedef struct ProfileThread
+{
+    uint64_t head; // events ever recorded. the newest is events[(head - 1) % PROFILER_RING_SIZE]
+    ProfileEvent events[PROFILER_RING_SIZE];
+    int index;     // in profileThreads, the trace's thread id
+    char name[32]; // guarded by profileThreadMutex
+} ProfileThread;
+
+static PROFILER_THREAD_LOCAL ProfileThread *currentProfileThread;
+static ProfileThread *profileThreads[PROFILER_MAX_THREADS];
+static int profileThreadCount;
+static pthread_mutex_t profileThreadMutex = PTHREAD_MUTEX_INITIALIZER;
+
+// start of the last PROFILER_FRAMES frames, see profilerFrame. only touched by the thread calling it
+static uint64_t frameStarts[PROFILER_FRAMES];
+static uint64_t markedFrames;
+static int frameThread = -1; // which thread marks the frames
+
+// scratch for the stats and traces, which only the frame thread asks for
+static ProfileEvent eventScratch[PROFILER_RING_SIZE];
+static double stageFrameTimes[PROFILER_MAX_STAGES][PROFILER_FRAMES];
+static double sortScratch[PROFILER_FRAMES];
+
+// Monotonic clock, in nanoseconds
+uint64_t profilerNow(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+// The calling thread's ring, made the first time it records. NULL once PROFILER_MAX_THREADS threads have one
+static ProfileThread *getProfileThread(void)
+{
+    if (currentProfileThread != NULL)
+        return currentProfileThread;
+    pthread_mutex_lock(&profileThreadMutex);
+    int index = profileThreadCount;
+    if (index < PROFILER_MAX_THREADS)
+    {
+        ProfileThread *thread = calloc(1, sizeof(ProfileThread));
+        thread->index = index;
+        snprintf(thread->name, sizeof(thread->name), "thread %d", index);
+        profileThreads[index] = thread;
+        storeRelease(profileThreadCount, index + 1);
+        currentProfileThread = thread;
+    }
+    pthread_mutex_unlock(&profileThreadMutex);
+    return currentProfileThread;
+}
+
+// Record an event for the calling thread, from start until now. name has to outlive the profiler (a string literal)
+void profilerRecord(const char *name, uint64_t start)
+{
+    uint64_t end = profilerNow();
+    ProfileThread *thread = getProfileThread();
+    if (thread == NULL)
+        return;
+    uint64_t head = thread->head;
+    ProfileEvent *event = &thread->events[head & (PROFILER_RING_SIZE - 1)];
+    storeRelaxed(event->name, name);
+    storeRelaxed(event->start, start);
+    storeRelaxed(event->end, end);
+    storeRelease(thread->head, head + 1);
+}
+
+// Name the calling thread in traces
+void profilerNameThread(const char *name)
+{
+    ProfileThread *thread = getProfileThread();
+    if (thread == NULL)
+        return;
+    pthread_mutex_lock(&profileThreadMutex);
+    snprintf(thread->name, sizeof(thread->name), "%s", name);
+    pthread_mutex_unlock(&profileThreadMutex);
+}
+
+// Start a new frame. Call it from one thread only, the one that also asks for stats and traces
+void profilerFrame(void)
+{
+    uint64_t now = profilerNow();
+    if (frameThread == -1 && getProfileThread() != NULL)
+        frameThread = getProfileThread()->index;
+    frameStarts[markedFrames % PROFILER_FRAMES] = now;
+    markedFrames++;
+}
+
+static uint64_t getFrameStart(uint64_t frame)
+{
+    return frameStarts[frame % PROFILER_FRAMES];
+}
+
+// Copy a thread's events that are still intact into eventScratch, oldest first. Returns how many
+static int copyProfileEvents(ProfileThread *thread)
+{
+    uint64_t head = loadAcquire(thread->head);
+    uint64_t first = head > PROFILER_RING_SIZE ? head - PROFILER_RING_SIZE : 0;
+    for (uint64_t i = first; i < head; i++)
+    {
+        ProfileEvent *event = &thread->events[i & (PROFILER_RING_SIZE - 1)];
+        ProfileEvent *copy = &eventScratch[i - first];
+        // acquire, so head is only read again after the copy
+        copy->name = loadAcquire(event->name);
+        copy->start = loadAcquire(event->start);
+        copy->end = loadAcquire(event->end);
+    }
+    // the writer may have lapped the oldest ones while they were copied, and is maybe writing over the next
+    uint64_t newHead = loadAcquire(thread->head);
+    uint64_t intact = newHead >= PROFILER_RING_SIZE ? newHead - PROFILER_RING_SIZE + 1 : 0;
+    if (intact <= first)
+        return (int)(head - first);
+    if (intact >= head)
+        return 0;
+    memmove(eventScratch, eventScratch + (intact - first), (head - intact) * sizeof(ProfileEvent));
+    return (int)(head - intact);
+}
+
+// Finished frames still remembered, at most wanted. The frame in progress has no end yet
+static int getFinishedFrames(int wanted)
+{
+    uint64_t finished = markedFrames > 0 ? markedFrames - 1 : 0;
+    if (finished > PROFILER_FRAMES - 1)
+        finished = PROFILER_FRAMES - 1;
+    if (wanted < 0)
+        wanted = 0;
+    return finished < (uint64_t)wanted ? (int)finished : wanted;
+}
+
+static int compareStageNames(const void *a, const void *b)
+{
+    return strcmp(((const ProfileStageStats *)a)->name, ((const ProfileStageStats *)b)->name);
+}
+
+/*
+Time spent in each stage per frame, over the last frameCount finished frames, summed over every thread.
+Events count for the frame they ended in. Fills up to maxStages stats, sorted by name, and returns how many
+*/
+int getProfilerStageStats(ProfileStageStats *stats, int maxStages, int frameCount)
+{
+    frameCount = getFinishedFrames(frameCount);
+    if (frameCount == 0)
+        return 0;
+    if (maxStages > PROFILER_MAX_STAGES)
+        maxStages = PROFILER_MAX_STAGES;
+    uint64_t firstFrame = markedFrames - 1 - frameCount;
+    uint64_t windowStart = getFrameStart(firstFrame);
+    uint64_t windowEnd = getFrameStart(markedFrames - 1);
+
+    int stageCount = 0;
+    int threadCount = loadAcquire(profileThreadCount);
+    for (int t = 0; t < threadCount; t++)
+    {
+        int eventCount = copyProfileEvents(profileThreads[t]);
+        int frame = 0; // events end in order, so the frame only moves forward
+        for (int i = 0; i < eventCount; i++)
+        {
+            ProfileEvent *event = &eventScratch[i];
+            if (event->end < windowStart || event->end >= windowEnd)
+                continue;
+            while (event->end >= getFrameStart(firstFrame + frame + 1))
+                frame++;
+
+            int stage = 0;
+            while (stage < stageCount && strcmp(stats[stage].name, event->name) != 0)
+                stage++;
+            if (stage == stageCount)
+            {
+                if (stageCount == maxStages)
+                    continue;
+                stats[stage].name = event->name;
+                memset(stageFrameTimes[stage], 0, frameCount * sizeof(double));
+                stageCount++;
+            }
+            stageFrameTimes[stage][frame] += (event->end - event->start) / 1e6;
+        }
+    }
+
+    for (int stage = 0; stage < stageCount; stage++)
+    {
+        double total = 0;
+        for (int frame = 0; frame < frameCount; frame++)
+        {
+            sortScratch[frame] = stageFrameTimes[stage][frame];
+            total += sortScratch[frame];
+        }
+        qsort(sortScratch, frameCount, sizeof(double), compareDoubles);
+        int p99Index = (frameCount * 99 + 99) / 100 - 1;
+        stats[stage].averageMs = total / frameCount;
+        stats[stage].p99Ms = sortScratch[p99Index];
+        stats[stage].maxMs = sortScratch[frameCount - 1];
+    }
+    qsort(stats, stageCount, sizeof(ProfileStageStats), compareStageNames);
+    return stageCount;
+}
+
+static void writeTraceEvent(FILE *file, bool *first, const char *name, int thread, uint64_t start, uint64_t end, uint64_t origin)
+{
+    fprintf(file, "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+            *first ? "" : ",", name, thread, (start - origin) / 1e3, (end - start) / 1e3);
+    *first = false;
+}
+
+/*
+Write the last frameCount frames (and the one in progress) as Chrome trace_event JSON,
+for chrome://tracing or ui.perfetto.dev. Returns false if the file can't be written
+*/
+bool writeProfilerTrace(const char *path, int frameCount)
+{
+    FILE *file = fopen(path, "w");
+    if (file == NULL)
+        return false;
+    frameCount = getFinishedFrames(frameCount);
+    uint64_t now = profilerNow();
+    uint64_t firstFrame = markedFrames > 0 ? markedFrames - 1 - frameCount : 0;
+    uint64_t windowStart = markedFrames > 0 ? getFrameStart(firstFrame) : 0;
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    bool first = true;
+    int threadCount = loadAcquire(profileThreadCount);
+    pthread_mutex_lock(&profileThreadMutex);
+    for (int t = 0; t < threadCount; t++)
+    {
+        fprintf(file, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                first ? "" : ",", t, profileThreads[t]->name);
+        first = false;
+    }
+    pthread_mutex_unlock(&profileThreadMutex);
+
+    // frames on the thread that marks them, below its stages
+    for (uint64_t frame = firstFrame; markedFrames > 0 && frame < markedFrames; frame++)
+    {
+        uint64_t end = frame + 1 < markedFrames ? getFrameStart(frame + 1) : now;
+        writeTraceEvent(file, &first, "frame", frameThread, getFrameStart(frame), end, windowStart);
+    }
+    for (int t = 0; t < threadCount; t++)
+    {
+        int eventCount = copyProfileEvents(profileThreads[t]);
+        for (int i = 0; i < eventCount; i++)
+        {
+            ProfileEvent *event = &eventScratch[i];
+            if (event->end >= windowStart)
+                writeTraceEvent(file, &first, event->name, t, event->start, event->end, windowStart);
+        }
+    }
+    fprintf(file, "\n]}\n");
+    return fclose(file) == 0;
+}
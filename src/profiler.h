@@ -0,0 +1,59 @@
+#ifndef PROFILER_H_
+#define PROFILER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+Frame profiler. Stages are timed with PROFILE_BEGIN(name) / PROFILE_END(name) pairs in the same block,
+or PROFILE_SCOPE(name) in front of a statement. name is an identifier, and becomes the stage name.
+Each thread records into its own ring buffer, nothing is locked while timing.
+Build with -DNO_PROFILER (make PROFILER=FALSE) and every macro compiles to nothing, the rest of the API
+then just finds no events
+*/
+
+// events each thread keeps, oldest are overwritten. power of 2
+#define PROFILER_RING_SIZE 8192
+// most threads that can record
+#define PROFILER_MAX_THREADS 32
+// frames whose start is remembered, how far back stats and traces can look
+#define PROFILER_FRAMES 240
+// most distinct stage names in the stats
+#define PROFILER_MAX_STAGES 32
+
+#ifndef NO_PROFILER
+#define PROFILE_BEGIN(name) uint64_t name##ProfileStart = profilerNow()
+#define PROFILE_END(name) profilerRecord(#name, name##ProfileStart)
+// times the statement after it. a break or return out of it loses the event
+#define PROFILE_SCOPE(name) \
+    for (uint64_t name##ProfileStart = profilerNow(), name##ProfileOnce = 1; name##ProfileOnce; name##ProfileOnce = 0, profilerRecord(#name, name##ProfileStart))
+#define PROFILE_FRAME() profilerFrame()
+#define PROFILE_THREAD_NAME(threadName) profilerNameThread(threadName)
+#else
+#define PROFILE_BEGIN(name)
+#define PROFILE_END(name)
+#define PROFILE_SCOPE(name)
+#define PROFILE_FRAME()
+#define PROFILE_THREAD_NAME(threadName)
+#endif
+
+// Structs
+
+// How long a stage took per frame, over the last frames
+typedef struct ProfileStageStats
+{
+    const char *name;
+    double averageMs; // frames where the stage didn't run count as 0
+    double p99Ms;
+    double maxMs;
+} ProfileStageStats;
+
+// Functions
+uint64_t profilerNow(void);
+void profilerRecord(const char *name, uint64_t start);
+void profilerFrame(void);
+void profilerNameThread(const char *name);
+int getProfilerStageStats(ProfileStageStats *stats, int maxStages, int frameCount);
+bool writeProfilerTrace(const char *path, int frameCount);
+
+#endif
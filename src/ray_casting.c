@@ -1,19 +1,56 @@
 #include "raylib.h"
 #include "raymath.h"
+#include "rlgl.h"
 #include "world.h"
 #include "game_state.h"
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #include "player.h"
 #include "camera.h"
+#include "edge_buffer.h"
+#include "frame_arena.h"
+#include "chunks.h"
+#include "occluder_graph.h"
+#include "profiler.h"
 #include <stdio.h>
+
+// triangles handed to rlgl at once by drawSightTriangles, 3 vertices each
+#define SIGHT_BATCH_TRIANGLES 1024
+
 typedef struct SightPolygon
 {
     Vector2 *points;
     int pointCount;
 } SightPolygon;
 
+// Test a ray against a single edge. Returns true and sets t (distance along the ray) on a hit
+static inline bool intersectRayEdge(Vector2 origin, Vector2 direction, Edge *edge, float *t)
+{
+    // Line-line intersection using parametric form
+    Vector2 edgeDir = Vector2Subtract(edge->end, edge->start);
+    Vector2 toStart = Vector2Subtract(edge->start, origin);
+
+    float denominator = direction.x * edgeDir.y - direction.y * edgeDir.x;
+
+    // Lines are parallel
+    if (fabs(denominator) < 0.0001f)
+        return false;
+
+    float hitT = (toStart.x * edgeDir.y - toStart.y * edgeDir.x) / denominator;
+    float u = (toStart.x * direction.y - toStart.y * direction.x) / denominator;
+
+    // Check if intersection is valid
+    if (hitT > 0 && u >= 0 && u <= 1)
+    {
+        *t = hitT;
+        return true;
+    }
+    return false;
+}
+
 // Helper function to cast a ray and find intersection
+// Brute force: tests every edge. Kept as the reference for castRayGrid
 Vector2 castRay(Vector2 origin, Vector2 direction, Edge *edges, int edgeCount, float maxDistance)
 {
     Vector2 closest = Vector2Add(origin, Vector2Scale(direction, maxDistance));
@@ -21,33 +58,187 @@ Vector2 castRay(Vector2 origin, Vector2 direction, Edge *edges, int edgeCount, f
 
     for (int i = 0; i < edgeCount; i++)
     {
-        Edge *edge = &edges[i];
+        float t;
+        if (intersectRayEdge(origin, direction, &edges[i], &t) && t < closestDistance)
+        {
+            closestDistance = t;
+            closest = Vector2Add(origin, Vector2Scale(direction, t));
+        }
+    }
 
-        // Line-line intersection using parametric form
-        Vector2 edgeDir = Vector2Subtract(edge->end, edge->start);
-        Vector2 toStart = Vector2Subtract(edge->start, origin);
+    return closest;
+}
 
-        float denominator = direction.x * edgeDir.y - direction.y * edgeDir.x;
+// Test a ray against the edges on the boundary of one tile, keeping the closest hit
+static inline void intersectTileEdges(GameState *game, int tileX, int tileY, Vector2 origin, Vector2 direction, float *closestDistance)
+{
+    if (tileX < 0 || tileX >= game->roomWidth || tileY < 0 || tileY >= game->roomHeight)
+        return;
+    TileEdges *tileEdges = &game->roomTileEdges[tileY * game->roomWidth + tileX];
+    if (!tileEdges->isWall)
+        return;
+    int edgeIds[4] = {tileEdges->northEdgeId, tileEdges->southEdgeId, tileEdges->eastEdgeId, tileEdges->westEdgeId};
+    for (int i = 0; i < 4; i++)
+    {
+        float t;
+        if (edgeIds[i] != -1 && intersectRayEdge(origin, direction, &game->roomEdges[edgeIds[i]], &t) && t < *closestDistance)
+        {
+            *closestDistance = t;
+        }
+    }
+}
 
-        // Lines are parallel
-        if (fabs(denominator) < 0.0001f)
+/*
+Cast a ray by walking the room's tile grid with a 2D DDA (Amanatides-Woo).
+Each wall tile knows the ids of the edges on its boundary (game->roomTileEdges), so the ray
+only tests the edges of the tiles it actually passes through, and stops at the first wall it hits.
+direction must be normalized. Returns the same point as castRay over game->roomEdges.
+*/
+Vector2 castRayGrid(GameState *game, Vector2 origin, Vector2 direction, float maxDistance)
+{
+    Vector2 miss = Vector2Add(origin, Vector2Scale(direction, maxDistance));
+    float tileSize = (float)game->tileSize;
+    float roomSize[2] = {game->roomWidth * tileSize, game->roomHeight * tileSize};
+    float rayOrigin[2] = {origin.x, origin.y};
+    float rayDir[2] = {direction.x, direction.y};
+
+    // clip the ray to the room bounds (slab test), so rays starting outside the room still walk the grid
+    float tMin = 0.0f;
+    float tMax = maxDistance;
+    for (int axis = 0; axis < 2; axis++)
+    {
+        if (rayDir[axis] == 0.0f)
+        {
+            if (rayOrigin[axis] < 0 || rayOrigin[axis] > roomSize[axis])
+                return miss;
             continue;
+        }
+        float t1 = (0 - rayOrigin[axis]) / rayDir[axis];
+        float t2 = (roomSize[axis] - rayOrigin[axis]) / rayDir[axis];
+        if (t1 > t2)
+        {
+            float tmp = t1;
+            t1 = t2;
+            t2 = tmp;
+        }
+        tMin = fmaxf(tMin, t1);
+        tMax = fminf(tMax, t2);
+    }
+    if (tMin > tMax)
+        return miss;
+
+    // starting tile
+    Vector2 start = Vector2Add(origin, Vector2Scale(direction, tMin));
+    int tileX = (int)floorf(start.x / tileSize);
+    int tileY = (int)floorf(start.y / tileSize);
+    tileX = tileX < 0 ? 0 : (tileX >= game->roomWidth ? game->roomWidth - 1 : tileX);
+    tileY = tileY < 0 ? 0 : (tileY >= game->roomHeight ? game->roomHeight - 1 : tileY);
+
+    // how far along the ray to cross one tile, and to reach the next tile boundary, on each axis
+    int stepX = direction.x > 0 ? 1 : -1;
+    int stepY = direction.y > 0 ? 1 : -1;
+    float tDeltaX = direction.x != 0.0f ? tileSize / fabsf(direction.x) : INFINITY;
+    float tDeltaY = direction.y != 0.0f ? tileSize / fabsf(direction.y) : INFINITY;
+    float tNextX = INFINITY;
+    float tNextY = INFINITY;
+    if (direction.x != 0.0f)
+        tNextX = ((tileX + (stepX > 0 ? 1 : 0)) * tileSize - origin.x) / direction.x;
+    if (direction.y != 0.0f)
+        tNextY = ((tileY + (stepY > 0 ? 1 : 0)) * tileSize - origin.y) / direction.y;
+
+    // a ray running exactly along a grid line also touches the corners of the tiles on the other side of it
+    int sideX = (direction.x == 0.0f && fmodf(origin.x, tileSize) == 0.0f) ? -1 : 0;
+    int sideY = (direction.y == 0.0f && fmodf(origin.y, tileSize) == 0.0f) ? -1 : 0;
 
-        float t = (toStart.x * edgeDir.y - toStart.y * edgeDir.x) / denominator;
-        float u = (toStart.x * direction.y - toStart.y * direction.x) / denominator;
+    float closestDistance = maxDistance;
+    while (true)
+    {
+        float tExit = fminf(tNextX, tNextY);
+        intersectTileEdges(game, tileX, tileY, origin, direction, &closestDistance);
+        if (sideX != 0 || sideY != 0)
+            intersectTileEdges(game, tileX + sideX, tileY + sideY, origin, direction, &closestDistance);
+        // passing exactly through a tile corner: also test the two tiles that share it
+        if (tNextX == tNextY)
+        {
+            intersectTileEdges(game, tileX + stepX, tileY, origin, direction, &closestDistance);
+            intersectTileEdges(game, tileX, tileY + stepY, origin, direction, &closestDistance);
+        }
+        // nothing in a later tile can be closer than a hit before this tile's exit
+        if (closestDistance <= tExit || tExit > tMax)
+            break;
 
-        // Check if intersection is valid
-        if (t > 0 && u >= 0 && u <= 1)
+        // step to the next tile
+        if (tNextX < tNextY)
         {
-            if (t < closestDistance)
-            {
-                closestDistance = t;
-                closest = Vector2Add(origin, Vector2Scale(direction, t));
-            }
+            tileX += stepX;
+            tNextX += tDeltaX;
+        }
+        else if (tNextY < tNextX)
+        {
+            tileY += stepY;
+            tNextY += tDeltaY;
+        }
+        else
+        {
+            tileX += stepX;
+            tileY += stepY;
+            tNextX += tDeltaX;
+            tNextY += tDeltaY;
         }
+        if (tileX < 0 || tileX >= game->roomWidth || tileY < 0 || tileY >= game->roomHeight)
+            break;
     }
 
-    return closest;
+    if (closestDistance < maxDistance)
+        return Vector2Add(origin, Vector2Scale(direction, closestDistance));
+    return miss;
+}
+
+/*
+The room's edges, or a list gathered from them (gatherRoomEdges holds every room edge within maxDistance).
+Walking the room's tile grid then gives the same hits, and only visits the tiles along the ray
+*/
+static bool isRoomEdgeList(GameState *game, Edge *edges)
+{
+    return edges == game->roomEdges || !game->useChunkWorld;
+}
+
+/*
+Trace a ray with the game's selected ray casting mode, for the grid and brute force casters.
+The grid caster can only be used for the room's edges, anything else falls back to brute force
+*/
+static Vector2 traceRay(GameState *game, Vector2 origin, Vector2 direction, Edge *edges, int edgeCount, float maxDistance)
+{
+    if (game->rayCastMode == RAYCAST_GRID && isRoomEdgeList(game, edges) && game->roomTileEdges != NULL)
+    {
+        return castRayGrid(game, origin, direction, maxDistance);
+    }
+    return castRay(origin, direction, edges, edgeCount, maxDistance);
+}
+
+/*
+Trace many rays from the same origin. The SIMD caster takes them as one batch, over the edges it was given:
+roomEdgeBuffer for the room's own list, otherwise a SoA copy of the list in the arena, so the cost follows
+the edges in range and not the size of the map
+*/
+static void traceRays(GameState *game, Vector2 origin, const Vector2 *directions, int rayCount, Edge *edges, int edgeCount, float maxDistance, Vector2 *hits, FrameArena *arena)
+{
+    if (game->rayCastMode == RAYCAST_SIMD)
+    {
+        EdgeBuffer gathered;
+        EdgeBuffer *buffer = game->roomEdgeBuffer;
+        if (edges != game->roomEdges || buffer == NULL)
+        {
+            buildEdgeBufferInArena(&gathered, edges, edgeCount, arena);
+            buffer = &gathered;
+        }
+        castRaysBatch(buffer, origin, directions, rayCount, maxDistance, hits);
+        return;
+    }
+    for (int i = 0; i < rayCount; i++)
+    {
+        hits[i] = traceRay(game, origin, directions[i], edges, edgeCount, maxDistance);
+    }
 }
 
 // Helper function to normalize angle to [0, 2π]
@@ -79,6 +270,7 @@ typedef struct AnglePoint
     float angle;
     Vector2 point;
     bool isValid;
+    bool stopsAtPoint; // single ray at a corner that blocks it. point is set to the corner before tracing
 } AnglePoint;
 
 // Comparison function for AnglePoint
@@ -94,12 +286,17 @@ int compareAnglePoints(const void *a, const void *b)
     return 0;
 }
 
-Triangle *calculateSightTriangles(Vector2 origin, Edge *edges, int edgeCount, float maxDistance, GameState *game)
+// rays cast around the whole range circle by the ray fan, on top of the ones at edge endpoints
+#define RAY_FAN_RANGE_RAYS 64
+
+/*
+Ray fan visibility: cast rays at every wall corner (3 where the corner could be a silhouette, 1 where it can't),
+sort the hits by angle and drop near duplicates
+*/
+static Triangle *calculateSightTrianglesRayFan(SightTriangles *sight, Vector2 origin, Edge *edges, int edgeCount, float maxDistance, GameState *game, FrameArena *arena)
 {
-    if (game->triangles != NULL)
-    {
-        free(game->triangles);
-    }
+    // scratch buffers come from the arena and are given back before returning
+    ArenaMark mark = arenaMark(arena);
 
     // Get screen corners in world coordinates
     // Vector2 screenCorners[4] = {
@@ -109,9 +306,14 @@ Triangle *calculateSightTriangles(Vector2 origin, Edge *edges, int edgeCount, fl
     //     GetScreenToWorld2D((Vector2){0, game->screenHeight}, game->playerCamera->camera)                  // Bottom-left
     // };
 
+    // the corners the edges meet at, each with the edges that meet there
+    OccluderGraph graph;
+    buildOccluderGraph(&graph, edges, edgeCount, arena);
+
     // // Create array to hold angle-point pairs
-    int maxPoints = edgeCount * 6;
-    AnglePoint *anglePoints = malloc(maxPoints * sizeof(AnglePoint));
+    int maxPoints = graph.vertexCount * 3 + RAY_FAN_RANGE_RAYS;
+    AnglePoint *anglePoints = arenaAlloc(arena, maxPoints * sizeof(AnglePoint));
+    Vector2 *directions = arenaAlloc(arena, maxPoints * sizeof(Vector2));
     int pointCount = 0;
 
     // // FIRST: Add screen corner points
@@ -133,61 +335,64 @@ Triangle *calculateSightTriangles(Vector2 origin, Edge *edges, int edgeCount, fl
     //     }
     // }
 
-    if (edgeCount > 0)
+    // Generate rays to the corners of the walls with small offsets, once per corner however many edges meet there
+    for (int i = 0; i < graph.vertexCount; i++)
     {
+        OccluderVertex *vertex = &graph.vertices[i];
+        int rayCount = getOccluderVertexRayCount(vertex, origin);
+        if (rayCount == 0)
+            continue;
 
-        // Generate rays to edge endpoints with small offsets
-        for (int i = 0; i < edgeCount; i++)
+        Vector2 toVertex = Vector2Subtract(vertex->position, origin);
+        if (Vector2Length(toVertex) > 0.1f) // Skip if too close
         {
-            // Process start point
-            Vector2 toStart = Vector2Subtract(edges[i].start, origin);
-            if (Vector2Length(toStart) > 0.1f) // Skip if too close
-            {
-                float baseAngle = atan2f(toStart.y, toStart.x);
-
-                // Cast rays with small angular offsets
-                float offsets[] = {-0.0001f, 0.0f, 0.0001f};
-                for (int j = 0; j < 3; j++)
-                {
-                    float angle = baseAngle + offsets[j];
-                    Vector2 direction = {cosf(angle), sinf(angle)};
-                    Vector2 intersection = castRay(origin, direction, edges, edgeCount, maxDistance);
-
-                    anglePoints[pointCount].angle = normalizeAngle(angle);
-                    anglePoints[pointCount].point = intersection;
-                    anglePoints[pointCount].isValid = true;
-                    pointCount++;
-                }
-            }
+            float baseAngle = atan2f(toVertex.y, toVertex.x);
 
-            // Process end point
-            Vector2 toEnd = Vector2Subtract(edges[i].end, origin);
-            if (Vector2Length(toEnd) > 0.1f) // Skip if too close
+            // Cast rays with small angular offsets, or just the one at the corner if it can't be slipped past
+            float offsets[] = {-0.0001f, 0.0f, 0.0001f};
+            int firstOffset = rayCount == 1 ? 1 : 0;
+            for (int j = firstOffset; j < firstOffset + rayCount; j++)
             {
-                float baseAngle = atan2f(toEnd.y, toEnd.x);
-
-                // Cast rays with small angular offsets
-                float offsets[] = {-0.0001f, 0.0f, 0.0001f};
-                for (int j = 0; j < 3; j++)
-                {
-                    float angle = baseAngle + offsets[j];
-                    Vector2 direction = {cosf(angle), sinf(angle)};
-                    Vector2 intersection = castRay(origin, direction, edges, edgeCount, maxDistance);
-
-                    anglePoints[pointCount].angle = normalizeAngle(angle);
-                    anglePoints[pointCount].point = intersection;
-                    anglePoints[pointCount].isValid = true;
-                    pointCount++;
-                }
+                float angle = baseAngle + offsets[j];
+                // rays are traced all at once below
+                directions[pointCount] = (Vector2){cosf(angle), sinf(angle)};
+
+                anglePoints[pointCount].angle = normalizeAngle(angle);
+                anglePoints[pointCount].isValid = true;
+                anglePoints[pointCount].stopsAtPoint = rayCount == 1;
+                anglePoints[pointCount].point = vertex->position;
+                pointCount++;
             }
         }
     }
 
+    // evenly spaced rays, so open space is bounded by the range circle even with no edge endpoints in that direction
+    for (int i = 0; i < RAY_FAN_RANGE_RAYS; i++)
+    {
+        float angle = i * 2 * PI / RAY_FAN_RANGE_RAYS;
+        directions[pointCount] = (Vector2){cosf(angle), sinf(angle)};
+        anglePoints[pointCount].angle = angle;
+        anglePoints[pointCount].isValid = true;
+        anglePoints[pointCount].stopsAtPoint = false;
+        pointCount++;
+    }
+
+    // Trace every ray in one batch
+    Vector2 *hits = arenaAlloc(arena, maxPoints * sizeof(Vector2));
+    traceRays(game, origin, directions, pointCount, edges, edgeCount, maxDistance, hits, arena);
+    for (int i = 0; i < pointCount; i++)
+    {
+        // a ray aimed exactly at a corner can slip between the ends of its two edges, but nothing behind it is visible
+        if (anglePoints[i].stopsAtPoint && Vector2Distance(origin, hits[i]) > Vector2Distance(origin, anglePoints[i].point))
+            continue;
+        anglePoints[i].point = hits[i];
+    }
+
     // Sort by angle
     qsort(anglePoints, pointCount, sizeof(AnglePoint), compareAnglePoints);
 
     // // Remove duplicate points and build final polygon
-    AnglePoint *finalAnglePoints = malloc(maxPoints * sizeof(AnglePoint));
+    AnglePoint *finalAnglePoints = arenaAlloc(arena, maxPoints * sizeof(AnglePoint));
     int finalPointCount = 0;
 
     for (int i = 0; i < pointCount; i++)
@@ -217,7 +422,9 @@ Triangle *calculateSightTriangles(Vector2 origin, Edge *edges, int edgeCount, fl
 
     // printf("Generated sight polygon with %d points from %d angle-points\n", result.pointCount, pointCount);
     // build triangles out of angles. Each triangle should be made up of two angle points, and the origin
-    Triangle *triangles = malloc(pointCount * sizeof(Triangle));
+    // the triangles outlive the frame's scratch memory, so they go in the sight's persistent buffer
+    sight->triangles = growBuffer(arena, sight->triangles, &sight->triangleCapacity, finalPointCount, sizeof(Triangle));
+    Triangle *triangles = sight->triangles;
 
     for (int i = 0; i < finalPointCount - 1; i++) // Note the -1 here
     {
@@ -232,26 +439,454 @@ Triangle *calculateSightTriangles(Vector2 origin, Edge *edges, int edgeCount, fl
         triangles[finalPointCount - 1].point2 = finalAnglePoints[finalPointCount - 1].point;
         triangles[finalPointCount - 1].point3 = finalAnglePoints[0].point; // Wrap to first point
     }
-    game->triangles = triangles;
-    game->triangleCount = finalPointCount;
+    sight->triangleCount = finalPointCount;
 
-    free(anglePoints);
-    free(finalAnglePoints);
-    game->triangleCount = finalPointCount;
+    arenaRelease(arena, mark);
     return triangles;
 }
 
-// Draw the sight polygon
-void drawSightPolygon(GameState *game, Color color)
+// One edge (or half of an edge split at the sweep seam) as seen from the light origin
+typedef struct SweepSegment
+{
+    Vector2 start;    // endpoint with the smaller angle
+    Vector2 end;      // endpoint with the larger angle
+    float startAngle; // in [-PI, PI]
+    float endAngle;   // in [-PI, PI], always >= startAngle
+    int heapIndex;    // position in the active set, -1 if not active
+} SweepSegment;
+
+// Sweep event: a segment starts or stops being crossed by the sweep ray
+typedef struct SweepEvent
+{
+    float angle;
+    int segment;
+    bool isEnd;
+} SweepEvent;
+
+// Sort by angle. At the same angle, segments that end are handled before segments that start
+int compareSweepEvents(const void *a, const void *b)
 {
-    for (int i = 0; i < game->triangleCount; i++)
+    const SweepEvent *ea = (const SweepEvent *)a;
+    const SweepEvent *eb = (const SweepEvent *)b;
+
+    if (ea->angle < eb->angle)
+        return -1;
+    if (ea->angle > eb->angle)
+        return 1;
+    return (int)eb->isEnd - (int)ea->isEnd;
+}
+
+// Distance from the origin to the segment's line, along the ray at the given angle
+static float sweepSegmentDistance(SweepSegment *segment, Vector2 origin, float angle)
+{
+    Vector2 direction = {cosf(angle), sinf(angle)};
+    Vector2 segmentDir = Vector2Subtract(segment->end, segment->start);
+    Vector2 toStart = Vector2Subtract(segment->start, origin);
+    float denominator = direction.x * segmentDir.y - direction.y * segmentDir.x;
+    if (fabs(denominator) < 0.000001f)
+        return Vector2Length(toStart);
+    return (toStart.x * segmentDir.y - toStart.y * segmentDir.x) / denominator;
+}
+
+/*
+Is segment a in front of (closer to the origin than) segment b?
+Both segments are active, so their angle ranges overlap. Edges never cross, so the order is the
+same anywhere in the overlap; compare in the middle of it to stay away from shared endpoints.
+*/
+static bool sweepSegmentInFront(SweepSegment *a, SweepSegment *b, Vector2 origin)
+{
+    float overlapStart = fmaxf(a->startAngle, b->startAngle);
+    float overlapEnd = fminf(a->endAngle, b->endAngle);
+    float angle = (overlapStart + overlapEnd) / 2;
+    return sweepSegmentDistance(a, origin, angle) < sweepSegmentDistance(b, origin, angle);
+}
+
+// Active edge set: binary min-heap of segment ids ordered by distance along the sweep ray
+typedef struct SweepHeap
+{
+    int *items;
+    int count;
+    SweepSegment *segments;
+    Vector2 origin;
+} SweepHeap;
+
+static void sweepHeapSwap(SweepHeap *heap, int i, int j)
+{
+    int tmp = heap->items[i];
+    heap->items[i] = heap->items[j];
+    heap->items[j] = tmp;
+    heap->segments[heap->items[i]].heapIndex = i;
+    heap->segments[heap->items[j]].heapIndex = j;
+}
+
+static bool sweepHeapLess(SweepHeap *heap, int i, int j)
+{
+    return sweepSegmentInFront(&heap->segments[heap->items[i]], &heap->segments[heap->items[j]], heap->origin);
+}
+
+static void sweepHeapSiftUp(SweepHeap *heap, int i)
+{
+    while (i > 0 && sweepHeapLess(heap, i, (i - 1) / 2))
+    {
+        sweepHeapSwap(heap, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+static void sweepHeapSiftDown(SweepHeap *heap, int i)
+{
+    while (true)
+    {
+        int smallest = i;
+        int left = 2 * i + 1;
+        int right = 2 * i + 2;
+        if (left < heap->count && sweepHeapLess(heap, left, smallest))
+            smallest = left;
+        if (right < heap->count && sweepHeapLess(heap, right, smallest))
+            smallest = right;
+        if (smallest == i)
+            return;
+        sweepHeapSwap(heap, i, smallest);
+        i = smallest;
+    }
+}
+
+static void sweepHeapInsert(SweepHeap *heap, int segment)
+{
+    heap->items[heap->count] = segment;
+    heap->segments[segment].heapIndex = heap->count;
+    heap->count++;
+    sweepHeapSiftUp(heap, heap->count - 1);
+}
+
+static void sweepHeapRemove(SweepHeap *heap, int segment)
+{
+    int i = heap->segments[segment].heapIndex;
+    if (i < 0)
+        return;
+    heap->count--;
+    if (i != heap->count)
     {
-        Vector2 point3 = GetWorldToScreen2D(game->triangles[i].point3, game->playerCamera->camera);
-        Vector2 point2 = GetWorldToScreen2D(game->triangles[i].point2, game->playerCamera->camera);
-        Vector2 point1 = GetWorldToScreen2D(game->triangles[i].point1, game->playerCamera->camera);
-        DrawTriangle(point3, point2, point1, WHITE);
-        // DrawTriangle(game->triangles[i].point3, game->triangles[i].point2, game->triangles[i].point1, (Color){255, 255, 255, 20});
+        sweepHeapSwap(heap, i, heap->count);
+        sweepHeapSiftUp(heap, i);
+        sweepHeapSiftDown(heap, heap->segments[heap->items[i]].heapIndex);
     }
+    heap->segments[segment].heapIndex = -1;
+}
+
+// Add an edge (or part of one) to the sweep. Skips segments that are a single point as seen from the origin
+static void addSweepSegment(SweepSegment *segments, int *segmentCount, Vector2 start, float startAngle, Vector2 end, float endAngle)
+{
+    if (endAngle < startAngle)
+    {
+        Vector2 tmpPoint = start;
+        start = end;
+        end = tmpPoint;
+        float tmpAngle = startAngle;
+        startAngle = endAngle;
+        endAngle = tmpAngle;
+    }
+    if (endAngle - startAngle < 0.000001f)
+        return;
+    segments[*segmentCount] = (SweepSegment){start, end, startAngle, endAngle, -1};
+    (*segmentCount)++;
+}
+
+// Point where the sweep ray at the given angle meets a segment, or the range limit if nothing is there
+static Vector2 sweepPoint(SweepHeap *heap, int segment, Vector2 origin, float angle, float maxDistance)
+{
+    float distance = maxDistance;
+    if (segment != -1)
+        distance = fminf(sweepSegmentDistance(&heap->segments[segment], origin, angle), maxDistance);
+    return (Vector2){origin.x + cosf(angle) * distance, origin.y + sinf(angle) * distance};
+}
+
+// Append a polygon point, skipping exact repeats of the previous one
+static void addSweepPolygonPoint(Vector2 *points, int *pointCount, Vector2 point)
+{
+    if (*pointCount > 0 && Vector2Distance(points[*pointCount - 1], point) < 0.001f)
+        return;
+    points[*pointCount] = point;
+    (*pointCount)++;
+}
+
+/*
+Angular sweep visibility, O(E log E).
+Edge endpoints are sorted by angle once. The sweep ray turns from -PI to PI keeping the edges it
+currently crosses in a heap ordered by distance, and polygon points are only emitted where the
+nearest edge changes. Edges crossing the seam at +-PI are split in two.
+*/
+static Triangle *calculateSightTrianglesSweep(SightTriangles *sight, Vector2 origin, Edge *edges, int edgeCount, float maxDistance, GameState *game, FrameArena *arena)
+{
+    // scratch buffers come from the arena and are given back before returning
+    ArenaMark mark = arenaMark(arena);
+
+    // every edge can become at most two segments
+    SweepSegment *segments = arenaAlloc(arena, (edgeCount * 2 + 1) * sizeof(SweepSegment));
+    int segmentCount = 0;
+    for (int i = 0; i < edgeCount; i++)
+    {
+        // slots freed by worldSetTile
+        if (!edges[i].visited)
+            continue;
+
+        Vector2 start = edges[i].start;
+        Vector2 end = edges[i].end;
+
+        // skip edges that are completely out of range
+        Vector2 closestOnEdge = start;
+        Vector2 edgeDir = Vector2Subtract(end, start);
+        float edgeLengthSqr = edgeDir.x * edgeDir.x + edgeDir.y * edgeDir.y;
+        if (edgeLengthSqr > 0)
+        {
+            float u = Clamp(Vector2DotProduct(Vector2Subtract(origin, start), edgeDir) / edgeLengthSqr, 0, 1);
+            closestOnEdge = Vector2Add(start, Vector2Scale(edgeDir, u));
+        }
+        float edgeDistance = Vector2Distance(closestOnEdge, origin);
+        // rays only hit edges in front of the origin, so an edge through the origin never blocks
+        if (edgeDistance > maxDistance || edgeDistance < 0.001f)
+            continue;
+
+        float startAngle = atan2f(start.y - origin.y, start.x - origin.x);
+        float endAngle = atan2f(end.y - origin.y, end.x - origin.x);
+        if (fabsf(endAngle - startAngle) <= PI)
+        {
+            addSweepSegment(segments, &segmentCount, start, startAngle, end, endAngle);
+            continue;
+        }
+        // the edge crosses the seam behind the origin (angle +-PI), split it where it does
+        float u = (origin.y - start.y) / (end.y - start.y);
+        Vector2 seamPoint = Vector2Add(start, Vector2Scale(edgeDir, u));
+        addSweepSegment(segments, &segmentCount, start, startAngle, seamPoint, startAngle > 0 ? PI : -PI);
+        addSweepSegment(segments, &segmentCount, seamPoint, endAngle > 0 ? PI : -PI, end, endAngle);
+    }
+
+    SweepEvent *events = arenaAlloc(arena, (segmentCount * 2 + 1) * sizeof(SweepEvent));
+    for (int i = 0; i < segmentCount; i++)
+    {
+        events[i * 2] = (SweepEvent){segments[i].startAngle, i, false};
+        events[i * 2 + 1] = (SweepEvent){segments[i].endAngle, i, true};
+    }
+    int eventCount = segmentCount * 2;
+    qsort(events, eventCount, sizeof(SweepEvent), compareSweepEvents);
+
+    SweepHeap heap = {arenaAlloc(arena, (segmentCount + 1) * sizeof(int)), 0, segments, origin};
+    // each event group adds at most two points
+    Vector2 *points = arenaAlloc(arena, (eventCount * 2 + 1) * sizeof(Vector2));
+    int pointCount = 0;
+
+    for (int i = 0; i < eventCount;)
+    {
+        float angle = events[i].angle;
+        int nearestBefore = heap.count > 0 ? heap.items[0] : -1;
+
+        // handle every event at this angle before looking at the nearest edge again
+        for (; i < eventCount && events[i].angle == angle; i++)
+        {
+            if (events[i].isEnd)
+                sweepHeapRemove(&heap, events[i].segment);
+            else
+                sweepHeapInsert(&heap, events[i].segment);
+        }
+
+        int nearestAfter = heap.count > 0 ? heap.items[0] : -1;
+        if (nearestAfter != nearestBefore || pointCount == 0)
+        {
+            // nothing comes before the seam at -PI or after it at PI
+            if (angle > -PI)
+                addSweepPolygonPoint(points, &pointCount, sweepPoint(&heap, nearestBefore, origin, angle, maxDistance));
+            if (angle < PI)
+                addSweepPolygonPoint(points, &pointCount, sweepPoint(&heap, nearestAfter, origin, angle, maxDistance));
+        }
+    }
+    // the last point sits on the seam too, drop it if it is the same as the first one
+    if (pointCount > 1 && Vector2Distance(points[0], points[pointCount - 1]) < 0.001f)
+        pointCount--;
+
+    // build triangles out of the polygon points and the origin, wrapping around at the end
+    sight->triangles = growBuffer(arena, sight->triangles, &sight->triangleCapacity, pointCount, sizeof(Triangle));
+    Triangle *triangles = sight->triangles;
+    for (int i = 0; i < pointCount; i++)
+    {
+        triangles[i].point1 = origin;
+        triangles[i].point2 = points[i];
+        triangles[i].point3 = points[(i + 1) % pointCount];
+    }
+    sight->triangleCount = pointCount;
+
+    arenaRelease(arena, mark);
+    return triangles;
+}
+
+// Build the cache key for a visibility calculation
+static VisibilityCacheKey makeVisibilityCacheKey(Vector2 origin, Edge *edges, int edgeCount, float maxDistance, GameState *game)
+{
+    VisibilityCacheKey key = {0};
+    key.valid = true;
+    key.originX = (int)floorf(origin.x / VISIBILITY_CACHE_QUANTUM);
+    key.originY = (int)floorf(origin.y / VISIBILITY_CACHE_QUANTUM);
+    key.maxDistance = maxDistance;
+    key.edges = edges;
+    key.edgeCount = edgeCount;
+    key.edgeVersion = game->roomEdgeVersion;
+    key.chunkWorld = game->useChunkWorld;
+    key.algorithm = game->visibilityAlgorithm;
+    key.rayCastMode = game->rayCastMode;
+    return key;
+}
+
+// Everything but the edges themselves, see isVisibilityCached
+static bool visibilitySettingsEqual(VisibilityCacheKey *a, VisibilityCacheKey *b)
+{
+    return a->valid && b->valid &&
+           a->originX == b->originX && a->originY == b->originY &&
+           a->maxDistance == b->maxDistance &&
+           a->edgeVersion == b->edgeVersion && a->chunkWorld == b->chunkWorld &&
+           a->algorithm == b->algorithm && a->rayCastMode == b->rayCastMode;
+}
+
+bool visibilityCacheKeysEqual(VisibilityCacheKey *a, VisibilityCacheKey *b)
+{
+    return visibilitySettingsEqual(a, b) && a->edges == b->edges && a->edgeCount == b->edgeCount;
+}
+
+/*
+Whether sight still holds the visibility from origin, checked before gathering the edges in range.
+Which edges are in range only depends on the origin, the range and the world, and the world can't change
+without bumping roomEdgeVersion, so a match means gathering them again would be wasted
+*/
+bool isVisibilityCached(SightTriangles *sight, Vector2 origin, float maxDistance, GameState *game)
+{
+    VisibilityCacheKey key = makeVisibilityCacheKey(origin, NULL, 0, maxDistance, game);
+    return sight->triangles != NULL && visibilitySettingsEqual(&key, &sight->key);
+}
+
+// Force the next calculateSightTriangles call to recalculate
+void invalidateVisibilityCache(GameState *game)
+{
+    game->playerSight.key.valid = false;
+}
+
+// As the -raycast flags of the headless build and the bench take them
+static const char *RAY_CAST_MODE_NAMES[] = {"grid", "brute", "simd"};
+
+const char *getRayCastModeName(RayCastMode mode)
+{
+    return RAY_CAST_MODE_NAMES[mode];
+}
+
+// Returns false if name isn't one of grid, brute or simd
+bool parseRayCastMode(const char *name, RayCastMode *mode)
+{
+    for (int i = 0; i < (int)(sizeof(RAY_CAST_MODE_NAMES) / sizeof(RAY_CAST_MODE_NAMES[0])); i++)
+    {
+        if (strcmp(name, RAY_CAST_MODE_NAMES[i]) == 0)
+        {
+            *mode = (RayCastMode)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+Step to the next way of working out visibility: the sweep, then the ray fan casting with the grid,
+brute force and SIMD in turn. The sweep casts no rays, so the ray cast mode only matters for the ray fan
+*/
+void cycleVisibilityMode(GameState *game)
+{
+    if (game->visibilityAlgorithm == VISIBILITY_ANGULAR_SWEEP)
+    {
+        game->visibilityAlgorithm = VISIBILITY_RAY_FAN;
+        game->rayCastMode = RAYCAST_GRID;
+    }
+    else if (game->rayCastMode == RAYCAST_GRID)
+        game->rayCastMode = RAYCAST_BRUTE_FORCE;
+    else if (game->rayCastMode == RAYCAST_BRUTE_FORCE)
+        game->rayCastMode = RAYCAST_SIMD;
+    else
+    {
+        game->visibilityAlgorithm = VISIBILITY_ANGULAR_SWEEP;
+        game->rayCastMode = RAYCAST_GRID;
+    }
+}
+
+/*
+Calculate the visibility polygon around origin into sight, with the game's selected algorithm.
+If the quantized origin, range, algorithm and edge set are the same as last time, sight already
+holds the answer and is returned as is.
+Only reads from game, so it can run on several threads at once as long as each has its own sight and arena.
+*/
+Triangle *calculateSightTrianglesInto(SightTriangles *sight, Vector2 origin, Edge *edges, int edgeCount, float maxDistance, GameState *game, FrameArena *arena, VisibilityCacheStats *stats)
+{
+    VisibilityCacheKey key = makeVisibilityCacheKey(origin, edges, edgeCount, maxDistance, game);
+    if (sight->triangles != NULL && visibilityCacheKeysEqual(&key, &sight->key))
+    {
+        stats->hits++;
+        return sight->triangles;
+    }
+    stats->misses++;
+
+    PROFILE_BEGIN(calculateSightTriangles);
+    Triangle *triangles;
+    if (game->visibilityAlgorithm == VISIBILITY_ANGULAR_SWEEP)
+    {
+        triangles = calculateSightTrianglesSweep(sight, origin, edges, edgeCount, maxDistance, game, arena);
+    }
+    else
+    {
+        triangles = calculateSightTrianglesRayFan(sight, origin, edges, edgeCount, maxDistance, game, arena);
+    }
+    sight->key = key;
+    PROFILE_END(calculateSightTriangles);
+    return triangles;
+}
+
+// Calculate the game's (player's) visibility polygon into game->playerSight
+Triangle *calculateSightTriangles(Vector2 origin, Edge *edges, int edgeCount, float maxDistance, GameState *game)
+{
+    return calculateSightTrianglesInto(&game->playerSight, origin, edges, edgeCount, maxDistance, game, game->frameArena, &game->visibilityCacheStats);
+}
+
+void freeSightTriangles(SightTriangles *sight)
+{
+    free(sight->triangles);
+    *sight = (SightTriangles){0};
+}
+
+/*
+Draw a triangle fan given in world coordinates onto the current (screen space) target.
+The camera matrix is worked out once for the whole fan (GetWorldToScreen2D builds it again for every point),
+and the triangles go to rlgl in batches of SIGHT_BATCH_TRIANGLES instead of a DrawTriangle each
+*/
+void drawSightTriangles(SightTriangles *sight, Camera2D camera, Color color)
+{
+    Matrix cameraMatrix = GetCameraMatrix2D(camera);
+    for (int first = 0; first < sight->triangleCount; first += SIGHT_BATCH_TRIANGLES)
+    {
+        int count = sight->triangleCount - first < SIGHT_BATCH_TRIANGLES ? sight->triangleCount - first : SIGHT_BATCH_TRIANGLES;
+        // draws what's batched so far if these wouldn't fit
+        rlCheckRenderBatchLimit(3 * count);
+        rlBegin(RL_TRIANGLES);
+        rlColor4ub(color.r, color.g, color.b, color.a);
+        for (int i = first; i < first + count; i++)
+        {
+            // same winding as DrawTriangle(point3, point2, point1) had
+            Vector2 point3 = Vector2Transform(sight->triangles[i].point3, cameraMatrix);
+            Vector2 point2 = Vector2Transform(sight->triangles[i].point2, cameraMatrix);
+            Vector2 point1 = Vector2Transform(sight->triangles[i].point1, cameraMatrix);
+            rlVertex2f(point3.x, point3.y);
+            rlVertex2f(point2.x, point2.y);
+            rlVertex2f(point1.x, point1.y);
+        }
+        rlEnd();
+    }
+}
+
+// Draw the sight polygon
+void drawSightPolygon(GameState *game, Color color)
+{
+    drawSightTriangles(&game->playerSight, game->playerCamera->camera, WHITE);
 }
 
 // Convenience function for game integration
@@ -268,5 +903,18 @@ Triangle *calculatePlayerSight(GameState *game, float sightRange)
 
     // Vector2 mousePos = GetScreenToWorld2D(GetMousePosition(), game->playerCamera->camera);
 
-    return calculateSightTriangles(playerCenter, game->roomEdges, game->roomEdgeCount, sightRange, game);
+    // nothing moved or changed, so neither did what the player can see
+    if (isVisibilityCached(&game->playerSight, playerCenter, sightRange, game))
+    {
+        game->visibilityCacheStats.hits++;
+        return game->playerSight.triangles;
+    }
+
+    // only the edges in range, so the cost doesn't grow with the size of the map
+    int edgeCount;
+    if (game->useChunkWorld)
+        edgeCount = gatherChunkEdges(game, playerCenter, sightRange, &game->sightEdges, &game->sightEdgeCapacity);
+    else
+        edgeCount = gatherRoomEdges(game, playerCenter, sightRange, &game->sightEdges, &game->sightEdgeCapacity);
+    return calculateSightTriangles(playerCenter, game->sightEdges, edgeCount, sightRange, game);
 }
\ No newline at end of file
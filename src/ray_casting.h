@@ -11,11 +11,22 @@ typedef struct SightPolygon
 } SightPolygon;
 
 // Core functions
+Vector2 castRay(Vector2 origin, Vector2 direction, Edge *edges, int edgeCount, float maxDistance);
+Vector2 castRayGrid(GameState *game, Vector2 origin, Vector2 direction, float maxDistance);
 Triangle *calculateSightTriangles(Vector2 origin, Edge *edges, int edgeCount, float maxDistance, GameState *game);
+Triangle *calculateSightTrianglesInto(SightTriangles *sight, Vector2 origin, Edge *edges, int edgeCount, float maxDistance, GameState *game, FrameArena *arena, VisibilityCacheStats *stats);
 Triangle *calculatePlayerSight(GameState *game, float sightRange);
+void invalidateVisibilityCache(GameState *game);
+bool isVisibilityCached(SightTriangles *sight, Vector2 origin, float maxDistance, GameState *game);
+bool visibilityCacheKeysEqual(VisibilityCacheKey *a, VisibilityCacheKey *b);
+void cycleVisibilityMode(GameState *game);
+const char *getRayCastModeName(RayCastMode mode);
+bool parseRayCastMode(const char *name, RayCastMode *mode);
 
 // Utility functions
 void drawSightPolygon(GameState *game, Color color);
+void drawSightTriangles(SightTriangles *sight, Camera2D camera, Color color);
+void freeSightTriangles(SightTriangles *sight);
 void freeSightPolygon(SightPolygon *polygon);
 
 #endif
\ No newline at end of file
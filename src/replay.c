@@ -0,0 +1,216 @@
+#include "raylib.h"
+#include "replay.h"
+#include "game_state.h"
+#include "frame_arena.h"
+#include "stats.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char INPUT_LOG_MAGIC[4] = {'R', 'L', 'O', 'G'};
+
+// Byte by byte, so the log reads the same on any platform
+static void writeUint16(FILE *file, unsigned int value)
+{
+    fputc(value & 0xff, file);
+    fputc((value >> 8) & 0xff, file);
+}
+
+static void writeFloat(FILE *file, float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    for (int i = 0; i < 4; i++)
+    {
+        fputc((bits >> (8 * i)) & 0xff, file);
+    }
+}
+
+static bool readUint16(FILE *file, int *value)
+{
+    int low = fgetc(file);
+    int high = fgetc(file);
+    if (low == EOF || high == EOF)
+        return false;
+    *value = low | high << 8;
+    return true;
+}
+
+static bool readFloat(FILE *file, float *value)
+{
+    uint32_t bits = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        int byte = fgetc(file);
+        if (byte == EOF)
+            return false;
+        bits |= (uint32_t)byte << (8 * i);
+    }
+    memcpy(value, &bits, sizeof(bits));
+    return true;
+}
+
+// Start logging every update of game to path. Returns false if the file can't be created
+bool startInputRecording(InputRecorder *recorder, const char *path, GameState *game)
+{
+    *recorder = (InputRecorder){0};
+    recorder->file = fopen(path, "wb");
+    if (recorder->file == NULL)
+        return false;
+    fwrite(INPUT_LOG_MAGIC, 1, sizeof(INPUT_LOG_MAGIC), recorder->file);
+    fputc(INPUT_LOG_VERSION, recorder->file);
+    writeUint16(recorder->file, game->screenWidth);
+    writeUint16(recorder->file, game->screenHeight);
+    // the first record always has a deltaTime
+    recorder->deltaTime = -1.0f;
+    return true;
+}
+
+// Log the input of one update. Called by updateGame
+void recordInputFrame(InputRecorder *recorder, GameInput *input, float deltaTime)
+{
+    unsigned char bits = (input->moveUp ? INPUT_LOG_UP : 0) | (input->moveDown ? INPUT_LOG_DOWN : 0) |
+                         (input->moveLeft ? INPUT_LOG_LEFT : 0) | (input->moveRight ? INPUT_LOG_RIGHT : 0) |
+                         (input->toggleWorld ? INPUT_LOG_TOGGLE_WORLD : 0) | (input->editTile ? INPUT_LOG_EDIT_TILE : 0) |
+                         (input->placeLight ? INPUT_LOG_PLACE_LIGHT : 0);
+    if (deltaTime != recorder->deltaTime)
+        bits |= INPUT_LOG_DELTA_TIME;
+    fputc(bits, recorder->file);
+    // the mouse only matters to clicks
+    if (input->editTile || input->placeLight)
+    {
+        writeFloat(recorder->file, input->mousePosition.x);
+        writeFloat(recorder->file, input->mousePosition.y);
+    }
+    if (bits & INPUT_LOG_DELTA_TIME)
+    {
+        writeFloat(recorder->file, deltaTime);
+        recorder->deltaTime = deltaTime;
+    }
+    recorder->frameCount++;
+}
+
+void stopInputRecording(InputRecorder *recorder)
+{
+    if (recorder->file != NULL)
+        fclose(recorder->file);
+    recorder->file = NULL;
+}
+
+// Read a whole log. Returns false if it can't be opened or isn't a log. A record cut off at the end is dropped
+bool loadInputLog(InputLog *log, const char *path)
+{
+    *log = (InputLog){0};
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+        return false;
+    char magic[sizeof(INPUT_LOG_MAGIC)];
+    if (fread(magic, 1, sizeof(magic), file) != sizeof(magic) || memcmp(magic, INPUT_LOG_MAGIC, sizeof(magic)) != 0 ||
+        fgetc(file) != INPUT_LOG_VERSION || !readUint16(file, &log->screenWidth) || !readUint16(file, &log->screenHeight))
+    {
+        fclose(file);
+        return false;
+    }
+
+    int capacity = 0;
+    float deltaTime = 0.0f;
+    int bits;
+    while ((bits = fgetc(file)) != EOF)
+    {
+        InputLogFrame frame = {0};
+        frame.input.moveUp = bits & INPUT_LOG_UP;
+        frame.input.moveDown = bits & INPUT_LOG_DOWN;
+        frame.input.moveLeft = bits & INPUT_LOG_LEFT;
+        frame.input.moveRight = bits & INPUT_LOG_RIGHT;
+        frame.input.toggleWorld = bits & INPUT_LOG_TOGGLE_WORLD;
+        frame.input.editTile = bits & INPUT_LOG_EDIT_TILE;
+        frame.input.placeLight = bits & INPUT_LOG_PLACE_LIGHT;
+        if ((frame.input.editTile || frame.input.placeLight) &&
+            (!readFloat(file, &frame.input.mousePosition.x) || !readFloat(file, &frame.input.mousePosition.y)))
+            break;
+        if ((bits & INPUT_LOG_DELTA_TIME) && !readFloat(file, &deltaTime))
+            break;
+        frame.deltaTime = deltaTime;
+
+        log->frames = growBuffer(NULL, log->frames, &capacity, log->frameCount + 1, sizeof(InputLogFrame));
+        log->frames[log->frameCount] = frame;
+        log->frameCount++;
+    }
+    fclose(file);
+    return true;
+}
+
+// The next update's input and deltaTime. Once the log runs out, nothing is pressed and deltaTime is left as is
+bool nextInputLogFrame(InputLog *log, GameInput *input, float *deltaTime)
+{
+    if (log->nextFrame >= log->frameCount)
+    {
+        *input = (GameInput){0};
+        return false;
+    }
+    *input = log->frames[log->nextFrame].input;
+    *deltaTime = log->frames[log->nextFrame].deltaTime;
+    log->nextFrame++;
+    return true;
+}
+
+bool isInputLogFinished(InputLog *log)
+{
+    return log->nextFrame >= log->frameCount;
+}
+
+void freeInputLog(InputLog *log)
+{
+    free(log->frames);
+    *log = (InputLog){0};
+}
+
+void addFrameTime(FrameTimes *times, double milliseconds)
+{
+    times->times = growBuffer(NULL, times->times, &times->capacity, times->count + 1, sizeof(double));
+    times->times[times->count] = milliseconds;
+    times->count++;
+}
+
+// Frame count, total, average and percentiles of the frame times
+void printFrameTimes(FrameTimes *times, FILE *out)
+{
+    if (times->count == 0)
+    {
+        fprintf(out, "no frames timed\n");
+        return;
+    }
+    double *sorted = malloc(times->count * sizeof(double));
+    memcpy(sorted, times->times, times->count * sizeof(double));
+    qsort(sorted, times->count, sizeof(double), compareDoubles);
+    double total = 0;
+    for (int i = 0; i < times->count; i++)
+    {
+        total += sorted[i];
+    }
+    int last = times->count - 1;
+    fprintf(out, "%d frames, %.1f ms: avg %.3f ms, p50 %.3f ms, p90 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+            times->count, total, total / times->count, sorted[last / 2], sorted[last * 90 / 100], sorted[last * 99 / 100], sorted[last]);
+    free(sorted);
+}
+
+// Every frame's time as CSV, for comparing runs frame by frame. Returns false if the file can't be written
+bool writeFrameTimes(FrameTimes *times, const char *path)
+{
+    FILE *file = fopen(path, "w");
+    if (file == NULL)
+        return false;
+    fprintf(file, "frame,ms\n");
+    for (int i = 0; i < times->count; i++)
+    {
+        fprintf(file, "%d,%.4f\n", i, times->times[i]);
+    }
+    return fclose(file) == 0;
+}
+
+void freeFrameTimes(FrameTimes *times)
+{
+    free(times->times);
+    *times = (FrameTimes){0};
+}
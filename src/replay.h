@@ -0,0 +1,72 @@
+#ifndef REPLAY_H_
+#define REPLAY_H_
+
+#include "raylib.h"
+#include "game_state.h"
+#include <stdio.h>
+
+/*
+Input recording and replay. The recorder logs the input and deltaTime of every updateGame,
+and replaying the log through updateGame from a fresh InitGame ends up in the same state.
+
+Log format, little endian: "RLOG", version byte, screen width and height (uint16 each), then one record per update:
+a byte of INPUT_LOG_ bits, the mouse position (2 float32) if the update clicked, and deltaTime (float32)
+if it changed since the last record. A fixed step run costs a byte per update
+*/
+#define INPUT_LOG_VERSION 1
+#define INPUT_LOG_UP (1 << 0)
+#define INPUT_LOG_DOWN (1 << 1)
+#define INPUT_LOG_LEFT (1 << 2)
+#define INPUT_LOG_RIGHT (1 << 3)
+#define INPUT_LOG_TOGGLE_WORLD (1 << 4)
+#define INPUT_LOG_EDIT_TILE (1 << 5)
+#define INPUT_LOG_PLACE_LIGHT (1 << 6)
+#define INPUT_LOG_DELTA_TIME (1 << 7)
+
+// Structs
+
+typedef struct InputRecorder
+{
+    FILE *file;
+    float deltaTime; // of the last record, written again only when it changes
+    int frameCount;
+} InputRecorder;
+
+typedef struct InputLogFrame
+{
+    GameInput input;
+    float deltaTime;
+} InputLogFrame;
+
+// A whole log read back, replayed one frame per updateGame
+typedef struct InputLog
+{
+    InputLogFrame *frames;
+    int frameCount;
+    int nextFrame;
+    int screenWidth; // of the recording, which decides the camera view and sight range
+    int screenHeight;
+} InputLog;
+
+// How long each frame took, for replay reports
+typedef struct FrameTimes
+{
+    double *times; // milliseconds
+    int count;
+    int capacity;
+} FrameTimes;
+
+// Functions
+bool startInputRecording(InputRecorder *recorder, const char *path, GameState *game);
+void recordInputFrame(InputRecorder *recorder, GameInput *input, float deltaTime);
+void stopInputRecording(InputRecorder *recorder);
+bool loadInputLog(InputLog *log, const char *path);
+bool nextInputLogFrame(InputLog *log, GameInput *input, float *deltaTime);
+bool isInputLogFinished(InputLog *log);
+void freeInputLog(InputLog *log);
+void addFrameTime(FrameTimes *times, double milliseconds);
+void printFrameTimes(FrameTimes *times, FILE *out);
+bool writeFrameTimes(FrameTimes *times, const char *path);
+void freeFrameTimes(FrameTimes *times);
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef STATS_H_
+#define STATS_H_
+
+// Small helpers for summarizing timings, shared by the profiler, the frame times of replay.c and the bench
+
+// qsort comparator for doubles, smallest first
+static inline int compareDoubles(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+#endif
@@ -2,7 +2,17 @@
 #include "world.h"
 #include "game_state.h"
 #include <stdlib.h>
+#include <string.h>
+#include <math.h>
 #include "camera.h"
+#include "edge_buffer.h"
+#include "frame_arena.h"
+#include "profiler.h"
+#include <pthread.h>
+#include <unistd.h>
+
+static unsigned char computeTileNeighborMask(GameState *game, int x, int y);
+
 /*
 Given a room width/height, generate a tile map for the room and set it as the game's roomTiles
 */
@@ -27,117 +37,39 @@ void loadRoomTiles(GameState *game, int roomWidth, int roomHeight)
             Tile *tile = &GET_TILE(game, x, y);
             if (x - barrierSize < 0 || x + barrierSize >= roomWidth || y - barrierSize < 0 || y + barrierSize >= roomHeight)
             {
-                tile->tileType = TILE_WALL;
+                SetTileType(tile, TILE_WALL);
             }
             else
             {
 
-                tile->tileType = TILE_FLOOR;
+                SetTileType(tile, TILE_FLOOR);
             }
-            tile->position = (Vector2){x * game->tileSize, y * game->tileSize};
         }
     }
+    // neighbour masks need every tile type set first
+    computeRoomNeighborMasks(game);
 }
-typedef enum Direction
-{
-    DIRECTION_NORTH = 0,
-    DIRECTION_EAST = 1,
-    DIRECTION_SOUTH = 2,
-    DIRECTION_WEST = 3
-} Direction;
-/*
-    0 = north
-    1 = east
-    2 = sout
-    3 = west
-*/
-bool hasNeighbor(GameState *game, Tile *tile, Direction direction)
-{
-    // Get tile coordinates
-    int tileX = (int)(tile->position.x / game->tileSize);
-    int tileY = (int)(tile->position.y / game->tileSize);
-
-    // Calculate neighbor coordinates
-    int neighborX = tileX;
-    int neighborY = tileY;
-
-    switch (direction)
-    {
-    case DIRECTION_NORTH:
-        neighborY -= 1;
-        break;
-    case DIRECTION_EAST:
-        neighborX += 1;
-        break;
-    case DIRECTION_SOUTH:
-        neighborY += 1;
-        break;
-    case DIRECTION_WEST:
-        neighborX -= 1;
-        break;
-    }
-
-    // Check bounds
-    if (neighborX < 0 || neighborX >= game->roomWidth ||
-        neighborY < 0 || neighborY >= game->roomHeight)
-    {
-        return true; // Out of bounds
-    }
 
-    // Check if neighbor tile exists and is the same type
-    Tile *neighborTile = &GET_TILE(game, neighborX, neighborY);
-    return (neighborTile->tileType == tile->tileType);
-}
-
-bool hasNeighborDiagonal(GameState *game, Tile *tile, Direction dir1, Direction dir2)
+// Work out the neighbour mask of every tile, after changing tile types in bulk. The whole tile layer is drawn again
+void computeRoomNeighborMasks(GameState *game)
 {
-    // Get tile coordinates
-    int tileX = (int)(tile->position.x / game->tileSize);
-    int tileY = (int)(tile->position.y / game->tileSize);
-
-    int neighborX = tileX;
-    int neighborY = tileY;
-
-    // Apply both direction offsets
-    if (dir1 == DIRECTION_NORTH || dir2 == DIRECTION_NORTH)
-        neighborY -= 1;
-    if (dir1 == DIRECTION_SOUTH || dir2 == DIRECTION_SOUTH)
-        neighborY += 1;
-    if (dir1 == DIRECTION_EAST || dir2 == DIRECTION_EAST)
-        neighborX += 1;
-    if (dir1 == DIRECTION_WEST || dir2 == DIRECTION_WEST)
-        neighborX -= 1;
-
-    // Check bounds
-    if (neighborX < 0 || neighborX >= game->roomWidth ||
-        neighborY < 0 || neighborY >= game->roomHeight)
+    for (int y = 0; y < game->roomHeight; y++)
     {
-        return true;
+        for (int x = 0; x < game->roomWidth; x++)
+        {
+            GET_TILE(game, x, y).neighborMask = computeTileNeighborMask(game, x, y);
+        }
     }
-
-    Tile *neighborTile = &GET_TILE(game, neighborX, neighborY);
-    return (neighborTile->tileType == tile->tileType);
+    game->roomTileLayerDirty = (TileRegion){0, 0, game->roomWidth - 1, game->roomHeight - 1};
 }
-
 /*
-Given a tile, return tile frames to render the 4 corners of the tile
+Given which of the 8 neighbours match a wall tile, return tile frames to render its 4 corners
 */
-TileCorners getTileFrames(GameState *game, Tile *tile)
+static TileCorners getTileCornersFromNeighbors(bool hasNorth, bool hasEast, bool hasSouth, bool hasWest,
+                                        bool hasNorthWest, bool hasNorthEast, bool hasSouthWest, bool hasSouthEast)
 {
     int edgeSize = 16 / 2; // tileset uses 16 pixels, and each corner of a tile is 8x8
 
-    // Check all 8 neighbors (including diagonals)
-    bool hasNorth = hasNeighbor(game, tile, DIRECTION_NORTH);
-    bool hasEast = hasNeighbor(game, tile, DIRECTION_EAST);
-    bool hasSouth = hasNeighbor(game, tile, DIRECTION_SOUTH);
-    bool hasWest = hasNeighbor(game, tile, DIRECTION_WEST);
-
-    // Check diagonal neighbors
-    bool hasNorthWest = hasNeighborDiagonal(game, tile, DIRECTION_NORTH, DIRECTION_WEST);
-    bool hasNorthEast = hasNeighborDiagonal(game, tile, DIRECTION_NORTH, DIRECTION_EAST);
-    bool hasSouthWest = hasNeighborDiagonal(game, tile, DIRECTION_SOUTH, DIRECTION_WEST);
-    bool hasSouthEast = hasNeighborDiagonal(game, tile, DIRECTION_SOUTH, DIRECTION_EAST);
-
     TileCorners result;
 
     // TOP LEFT CORNER
@@ -251,274 +183,876 @@ TileCorners getTileFrames(GameState *game, Tile *tile)
     return result;
 }
 
-void drawRoomTiles(GameState *game)
+// Tile frames for every neighbour mask, filled by initTileCornersTable
+static TileCorners tileCornersTable[256];
+
+// Work out the tile frames for all 256 neighbour masks once, so drawing is a table lookup
+void initTileCornersTable(void)
+{
+    for (int mask = 0; mask < 256; mask++)
+    {
+        tileCornersTable[mask] = getTileCornersFromNeighbors(
+            mask & NEIGHBOR_NORTH, mask & NEIGHBOR_EAST, mask & NEIGHBOR_SOUTH, mask & NEIGHBOR_WEST,
+            mask & NEIGHBOR_NORTH_WEST, mask & NEIGHBOR_NORTH_EAST, mask & NEIGHBOR_SOUTH_WEST, mask & NEIGHBOR_SOUTH_EAST);
+    }
+}
+
+TileCorners getTileCornersForMask(unsigned char neighborMask)
+{
+    return tileCornersTable[neighborMask];
+}
+
+// Bit for every neighbour of the same type as the tile. Outside the room counts as the same type
+static unsigned char computeTileNeighborMask(GameState *game, int x, int y)
+{
+    int tileType = GET_TILE(game, x, y).tileType;
+    unsigned char neighborMask = 0;
+    for (int i = 0; i < 8; i++)
+    {
+        int neighborX = x + NEIGHBOR_OFFSETS[i][0];
+        int neighborY = y + NEIGHBOR_OFFSETS[i][1];
+        if (neighborX < 0 || neighborX >= game->roomWidth || neighborY < 0 || neighborY >= game->roomHeight ||
+            GET_TILE(game, neighborX, neighborY).tileType == tileType)
+            neighborMask |= 1 << i;
+    }
+    return neighborMask;
+}
+
+// Recompute the neighbour masks of a tile and the 8 tiles around it, after it changed type. They all need to be drawn again
+static void updateTileNeighborMasks(GameState *game, int x, int y)
+{
+    for (int neighborY = y - 1; neighborY <= y + 1; neighborY++)
+    {
+        for (int neighborX = x - 1; neighborX <= x + 1; neighborX++)
+        {
+            if (neighborX < 0 || neighborX >= game->roomWidth || neighborY < 0 || neighborY >= game->roomHeight)
+                continue;
+            GET_TILE(game, neighborX, neighborY).neighborMask = computeTileNeighborMask(game, neighborX, neighborY);
+            growTileRegion(&game->roomTileLayerDirty, neighborX, neighborY);
+        }
+    }
+}
+
+// Draw one tile (floor, plus the 4 corners of a wall) as a square of the given size
+void drawTile(GameState *game, int tileType, unsigned char neighborMask, Vector2 position, float size)
 {
     // actual size of the texture
     Rectangle sourceRect = {0, 0, 16, 16};
-    for (int x = 0; x < game->roomWidth; x++)
+    Rectangle destRect = {position.x, position.y, size, size};
+    // DrawTexturePro allows us to scale the sprite to the dest size
+    DrawTexturePro(game->tileTextures[TILE_FLOOR], sourceRect, destRect, (Vector2){0, 0}, 0, WHITE);
+    if (tileType != TILE_WALL)
+        return;
+
+    Texture2D wallTexture = game->tileTextures[TILE_WALL];
+    TileCorners sourceTiles = getTileCornersForMask(neighborMask);
+    float halfSize = size / 2;
+    // top left
+    Rectangle topLeftDestRect = {position.x, position.y, halfSize, halfSize};
+    DrawTexturePro(wallTexture, sourceTiles.topLeft, topLeftDestRect, (Vector2){0, 0}, 0, WHITE);
+    // top right
+    Rectangle topRightDestRect = {position.x + halfSize, position.y, halfSize, halfSize};
+    DrawTexturePro(wallTexture, sourceTiles.topRight, topRightDestRect, (Vector2){0, 0}, 0, WHITE);
+    // bottom Left
+    Rectangle bottomLeftDestRect = {position.x, position.y + halfSize, halfSize, halfSize};
+    DrawTexturePro(wallTexture, sourceTiles.bottomLeft, bottomLeftDestRect, (Vector2){0, 0}, 0, WHITE);
+    // bottom Right
+    Rectangle bottomRightDestRect = {position.x + halfSize, position.y + halfSize, halfSize, halfSize};
+    DrawTexturePro(wallTexture, sourceTiles.bottomRight, bottomRightDestRect, (Vector2){0, 0}, 0, WHITE);
+}
+
+// Redraw the tiles of a region into a tile layer texture, at TILE_LAYER_PIXELS per tile. getTile gives the type and mask of a tile
+void bakeTileLayer(GameState *game, RenderTexture2D layer, TileRegion region, TileLayerSource getTile, void *source)
+{
+    BeginTextureMode(layer);
+    for (int y = region.minY; y <= region.maxY; y++)
     {
-        for (int y = 0; y < game->roomHeight; y++)
+        for (int x = region.minX; x <= region.maxX; x++)
         {
-            // get current tile
-            Tile *tile = &GET_TILE(game, x, y);
+            int tileType;
+            unsigned char neighborMask;
+            getTile(source, x, y, &tileType, &neighborMask);
+            Vector2 position = {(float)x * TILE_LAYER_PIXELS, (float)y * TILE_LAYER_PIXELS};
+            // the old tile is painted over, so it can't show through the transparent parts of the new one
+            DrawRectangle(position.x, position.y, TILE_LAYER_PIXELS, TILE_LAYER_PIXELS, BLACK);
+            drawTile(game, tileType, neighborMask, position, TILE_LAYER_PIXELS);
+        }
+    }
+    EndTextureMode();
+}
+
+// Draw a tile layer texture over a rectangle of the world
+void drawTileLayer(RenderTexture2D layer, Rectangle destRect)
+{
+    // render textures are stored upside down
+    Rectangle sourceRect = {0, 0, (float)layer.texture.width, -(float)layer.texture.height};
+    DrawTexturePro(layer.texture, sourceRect, destRect, (Vector2){0, 0}, 0, WHITE);
+}
+
+// Range of tile layer blocks the camera can see, plus a margin of blocks, clamped to the room
+static void getVisibleTileLayerBlocks(GameState *game, int margin, int *minBlockX, int *minBlockY, int *maxBlockX, int *maxBlockY)
+{
+    Rectangle view = getCameraViewRect(game);
+    float blockPixels = (float)TILE_LAYER_BLOCK_SIZE * game->tileSize;
+    *minBlockX = (int)floorf(view.x / blockPixels) - margin;
+    *minBlockY = (int)floorf(view.y / blockPixels) - margin;
+    *maxBlockX = (int)floorf((view.x + view.width) / blockPixels) + margin;
+    *maxBlockY = (int)floorf((view.y + view.height) / blockPixels) + margin;
+    *minBlockX = *minBlockX < 0 ? 0 : *minBlockX;
+    *minBlockY = *minBlockY < 0 ? 0 : *minBlockY;
+    *maxBlockX = *maxBlockX >= game->roomTileLayerColumns ? game->roomTileLayerColumns - 1 : *maxBlockX;
+    *maxBlockY = *maxBlockY >= game->roomTileLayerRows ? game->roomTileLayerRows - 1 : *maxBlockY;
+}
+
+// Unload every tile layer block of the room
+void unloadRoomTileLayers(GameState *game)
+{
+    for (int i = 0; i < game->roomTileLayerColumns * game->roomTileLayerRows; i++)
+    {
+        if (game->roomTileLayers[i].id != 0)
+            UnloadRenderTexture(game->roomTileLayers[i]);
+    }
+    free(game->roomTileLayers);
+    game->roomTileLayers = NULL;
+    game->roomTileLayerColumns = 0;
+    game->roomTileLayerRows = 0;
+    game->roomTileLayerBlocks = EMPTY_TILE_REGION;
+}
+
+// Tiles of a block, for bakeTileLayer, which takes the block's own tile coordinates
+typedef struct RoomTileLayerBlock
+{
+    GameState *game;
+    int firstX;
+    int firstY;
+} RoomTileLayerBlock;
+
+static void getRoomTile(void *source, int x, int y, int *tileType, unsigned char *neighborMask)
+{
+    RoomTileLayerBlock *block = (RoomTileLayerBlock *)source;
+    Tile *tile = &GET_TILE(block->game, block->firstX + x, block->firstY + y);
+    *tileType = tile->tileType;
+    *neighborMask = tile->neighborMask;
+}
 
-            // check mouse collision
-            // Vector2 MousePos = GetMousePosition();
-            // Vector2 MousePosInWorld = GetScreenToWorld2D(MousePos, game->playerCamera->camera);
-            // Rectangle tileRec = {tile->position.x, tile->position.y, game->tileSize, game->tileSize};
-            // if (CheckCollisionPointRec(MousePosInWorld, tileRec))
-            // {
-            //     // if the mouse is in this tile, color it red
-            //     DrawRectangle(tile->position.x + 1, tile->position.y + 1, game->tileSize - 2, game->tileSize - 2, RED);
-            // }
-            // draw each corner of the tile
-            // only for walls
-            Texture2D tileTexture = game->tileTextures[TILE_FLOOR];
-            Rectangle destRect = {tile->position.x, tile->position.y, game->tileSize, game->tileSize};
-            // DrawTexturePro allows us to scale the sprite to the dest size
-            DrawTexturePro(tileTexture, sourceRect, destRect, (Vector2){0, 0}, 0, WHITE);
-            if (tile->tileType == TILE_WALL)
+/*
+Bring the room's tile layers up to date. The room is split in blocks of TILE_LAYER_BLOCK_SIZE tiles, and only
+blocks near the camera have a layer, so a big room costs no more than a small one. Blocks coming into view are
+drawn whole, the others only where tiles changed since the last bake. Has to be called outside of any other texture mode
+*/
+void bakeRoomTileLayer(GameState *game)
+{
+    int columns = (game->roomWidth + TILE_LAYER_BLOCK_SIZE - 1) / TILE_LAYER_BLOCK_SIZE;
+    int rows = (game->roomHeight + TILE_LAYER_BLOCK_SIZE - 1) / TILE_LAYER_BLOCK_SIZE;
+    if (game->roomTileLayers == NULL || game->roomTileLayerColumns != columns || game->roomTileLayerRows != rows)
+    {
+        unloadRoomTileLayers(game);
+        game->roomTileLayers = calloc(columns * rows, sizeof(RenderTexture2D));
+        game->roomTileLayerColumns = columns;
+        game->roomTileLayerRows = rows;
+    }
+
+    TileRegion blocks;
+    getVisibleTileLayerBlocks(game, 1, &blocks.minX, &blocks.minY, &blocks.maxX, &blocks.maxY);
+
+    // blocks that went out of view are drawn again from scratch if they come back
+    TileRegion oldBlocks = game->roomTileLayerBlocks;
+    for (int blockY = oldBlocks.minY; blockY <= oldBlocks.maxY; blockY++)
+    {
+        for (int blockX = oldBlocks.minX; blockX <= oldBlocks.maxX; blockX++)
+        {
+            if (blockX >= blocks.minX && blockX <= blocks.maxX && blockY >= blocks.minY && blockY <= blocks.maxY)
+                continue;
+            RenderTexture2D *layer = &game->roomTileLayers[blockY * columns + blockX];
+            if (layer->id != 0)
+                UnloadRenderTexture(*layer);
+            *layer = (RenderTexture2D){0};
+        }
+    }
+    game->roomTileLayerBlocks = blocks;
+
+    TileRegion dirty = game->roomTileLayerDirty;
+    for (int blockY = blocks.minY; blockY <= blocks.maxY; blockY++)
+    {
+        for (int blockX = blocks.minX; blockX <= blocks.maxX; blockX++)
+        {
+            RenderTexture2D *layer = &game->roomTileLayers[blockY * columns + blockX];
+            RoomTileLayerBlock block = {game, blockX * TILE_LAYER_BLOCK_SIZE, blockY * TILE_LAYER_BLOCK_SIZE};
+            int lastX = block.firstX + TILE_LAYER_BLOCK_SIZE - 1 < game->roomWidth ? block.firstX + TILE_LAYER_BLOCK_SIZE - 1 : game->roomWidth - 1;
+            int lastY = block.firstY + TILE_LAYER_BLOCK_SIZE - 1 < game->roomHeight ? block.firstY + TILE_LAYER_BLOCK_SIZE - 1 : game->roomHeight - 1;
+
+            // everything for a new layer, otherwise the changed tiles inside this block
+            TileRegion region = {0, 0, lastX - block.firstX, lastY - block.firstY};
+            if (layer->id == 0)
             {
-                Texture2D wallTexture = game->tileTextures[TILE_WALL];
-                TileCorners sourceTiles = getTileFrames(game, tile);
-                // top left
-                Rectangle topLeftSourceRect = sourceTiles.topLeft;
-                Rectangle topLeftDestRect = {tile->position.x, tile->position.y, game->tileSize / 2, game->tileSize / 2};
-                DrawTexturePro(wallTexture, topLeftSourceRect, topLeftDestRect, (Vector2){0, 0}, 0, WHITE);
-                // top right
-                Rectangle topRightSourceRect = sourceTiles.topRight;
-                Rectangle topRightDestRect = {tile->position.x + game->tileSize / 2, tile->position.y, game->tileSize / 2, game->tileSize / 2};
-                DrawTexturePro(wallTexture, topRightSourceRect, topRightDestRect, (Vector2){0, 0}, 0, WHITE);
-                // bottom Left
-                Rectangle bottomLeftSourceRect = sourceTiles.bottomLeft;
-                Rectangle bottomLeftDestRect = {tile->position.x, tile->position.y + game->tileSize / 2, game->tileSize / 2, game->tileSize / 2};
-                DrawTexturePro(wallTexture, bottomLeftSourceRect, bottomLeftDestRect, (Vector2){0, 0}, 0, WHITE);
-                // bottom Right
-                Rectangle bottomRightSourceRect = sourceTiles.bottomRight;
-                Rectangle bottomRightDestRect = {tile->position.x + game->tileSize / 2, tile->position.y + game->tileSize / 2, game->tileSize / 2, game->tileSize / 2};
-                DrawTexturePro(wallTexture, bottomRightSourceRect, bottomRightDestRect, (Vector2){0, 0}, 0, WHITE);
+                *layer = LoadRenderTexture((region.maxX + 1) * TILE_LAYER_PIXELS, (region.maxY + 1) * TILE_LAYER_PIXELS);
             }
+            else
+            {
+                region.minX = (dirty.minX > block.firstX ? dirty.minX : block.firstX) - block.firstX;
+                region.minY = (dirty.minY > block.firstY ? dirty.minY : block.firstY) - block.firstY;
+                region.maxX = (dirty.maxX < lastX ? dirty.maxX : lastX) - block.firstX;
+                region.maxY = (dirty.maxY < lastY ? dirty.maxY : lastY) - block.firstY;
+            }
+            if (!isTileRegionEmpty(region))
+                bakeTileLayer(game, *layer, region, getRoomTile, &block);
         }
     }
+    game->roomTileLayerDirty = EMPTY_TILE_REGION;
+}
+
+// Draw the blocks of the room the camera can see, from their baked tile layers (see bakeRoomTileLayer)
+void drawRoomTiles(GameState *game)
+{
+    PROFILE_BEGIN(drawRoomTiles);
+    float blockPixels = (float)TILE_LAYER_BLOCK_SIZE * game->tileSize;
+    int minBlockX, minBlockY, maxBlockX, maxBlockY;
+    getVisibleTileLayerBlocks(game, 0, &minBlockX, &minBlockY, &maxBlockX, &maxBlockY);
+    for (int blockY = minBlockY; blockY <= maxBlockY; blockY++)
+    {
+        for (int blockX = minBlockX; blockX <= maxBlockX; blockX++)
+        {
+            RenderTexture2D layer = game->roomTileLayers[blockY * game->roomTileLayerColumns + blockX];
+            if (layer.id == 0)
+                continue;
+            float width = (float)layer.texture.width / TILE_LAYER_PIXELS * game->tileSize;
+            float height = (float)layer.texture.height / TILE_LAYER_PIXELS * game->tileSize;
+            drawTileLayer(layer, (Rectangle){blockX * blockPixels, blockY * blockPixels, width, height});
+        }
+    }
+    PROFILE_END(drawRoomTiles);
+}
+
+// Which edge id field of a tile holds the edge on the given side
+static int *getTileEdgeId(TileEdges *tileEdges, Direction side)
+{
+    switch (side)
+    {
+    case DIRECTION_NORTH:
+        return &tileEdges->northEdgeId;
+    case DIRECTION_EAST:
+        return &tileEdges->eastEdgeId;
+    case DIRECTION_SOUTH:
+        return &tileEdges->southEdgeId;
+    default:
+        return &tileEdges->westEdgeId;
+    }
+}
+
+// Tiles per bitboard word. Bit b of word w in a row is tile x = w * ROW_WORD_BITS + b
+#define ROW_WORD_BITS 64
+// most bands (threads) roomTilesToRoomLines splits a room into
+#define MAX_EDGE_BANDS 16
+// fewest rows in a band
+#define MIN_EDGE_BAND_ROWS 64
+// rooms with fewer tiles are done on the calling thread, starting threads would cost more than they save
+#define PARALLEL_EDGE_MIN_TILES (512 * 512)
+// tile edge id of a west/east face carrying on an edge from the band above, until stitchEdgeBands fills it in
+#define EDGE_ID_PENDING -2
+
+// What runEdgeBands should do with each band
+typedef enum EdgeBandStep
+{
+    EDGE_BAND_PACK,
+    EDGE_BAND_COUNT,
+    EDGE_BAND_EXTRACT
+} EdgeBandStep;
+
+// Rows [firstRow, endRow) of the room, extracted on one thread
+typedef struct EdgeBand
+{
+    GameState *game;
+    uint64_t *rows;  // opaque bits of the whole room, shared by every band. each band packs only its own rows
+    int wordsPerRow;
+    int firstRow;
+    int endRow;
+    int firstEdgeId; // the band's edges get ids from here, the same a single pass would give them
+    int edgeCount;
+    EdgeBandStep step;
+} EdgeBand;
+
+static int countTrailingZeros64(uint64_t bits)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(bits);
+#else
+    int count = 0;
+    while (!(bits & 1))
+    {
+        bits >>= 1;
+        count++;
+    }
+    return count;
+#endif
+}
+
+static int countBits64(uint64_t bits)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_popcountll(bits);
+#else
+    int count = 0;
+    for (; bits; bits &= bits - 1)
+        count++;
+    return count;
+#endif
 }
 
 /*
-    Given a 1D array of tiles, identify all contiguous edges of each group of tiles
-    This greatly reduces the number of points to check when calculating shadows
+Exposed faces of one word of a row of opaque bits, indexed by Direction. rows has an empty row before the first
+and after the last, and the bits past the room width are 0, so faces on the room bounds come out of the same shifts.
+West and east neighbours of the word's first and last tile come from the bit carried in from the next word over.
+*/
+static void getRowWordFaces(const uint64_t *rows, int wordsPerRow, int y, int word, uint64_t faces[4])
+{
+    const uint64_t *row = rows + y * wordsPerRow;
+    uint64_t bits = row[word];
+    uint64_t westCarry = word > 0 ? row[word - 1] >> (ROW_WORD_BITS - 1) : 0;
+    uint64_t eastCarry = word + 1 < wordsPerRow ? row[word + 1] << (ROW_WORD_BITS - 1) : 0;
+    faces[DIRECTION_NORTH] = bits & ~row[word - wordsPerRow];
+    faces[DIRECTION_SOUTH] = bits & ~row[word + wordsPerRow];
+    faces[DIRECTION_WEST] = bits & ~((bits << 1) | westCarry);
+    faces[DIRECTION_EAST] = bits & ~((bits >> 1) | eastCarry);
+}
 
-    For now, just operate on whole room
+/*
+Give each run of north or south faces in a word its edge. A run starting at bit 0 carries on the edge from the
+previous word when that one ran to its last bit, *openEdgeId holds that edge (-1 if none) and is left holding the
+run reaching this word's last bit. Returns the next free edge id
 */
-void roomTilesToRoomLines(GameState *game)
+static int extractRowRuns(GameState *game, uint64_t faces, int word, int y, Direction side, int edgeIndex, int *openEdgeId)
 {
-    if (game->roomEdges != NULL)
+    TileEdges *tileEdges = game->roomTileEdges + y * game->roomWidth;
+    float tileSize = game->tileSize;
+    int continuingEdgeId = *openEdgeId;
+    *openEdgeId = -1;
+    while (faces)
     {
-        free(game->roomEdges);
+        int start = countTrailingZeros64(faces);
+        uint64_t gaps = ~faces & (~(uint64_t)0 << start);
+        int end = gaps ? countTrailingZeros64(gaps) : ROW_WORD_BITS;
+        int x = word * ROW_WORD_BITS + start;
+
+        int edgeId;
+        if (start == 0 && continuingEdgeId != -1)
+        {
+            edgeId = continuingEdgeId;
+        }
+        else
+        {
+            edgeId = edgeIndex++;
+            Vector2 tilePosition = GET_TILE_POSITION(game, x, y);
+            game->roomEdges[edgeId].visited = true;
+            game->roomEdges[edgeId].start = (Vector2){tilePosition.x, tilePosition.y + (side == DIRECTION_SOUTH ? tileSize : 0)};
+        }
+        Edge *edge = &game->roomEdges[edgeId];
+        edge->end = (Vector2){(word * ROW_WORD_BITS + end) * tileSize, edge->start.y};
+        for (int tileX = x; tileX < word * ROW_WORD_BITS + end; tileX++)
+        {
+            *getTileEdgeId(&tileEdges[tileX], side) = edgeId;
+        }
+
+        if (end == ROW_WORD_BITS)
+        {
+            *openEdgeId = edgeId;
+            break;
+        }
+        faces &= ~(uint64_t)0 << end;
     }
+    return edgeIndex;
+}
 
-    // used to track which edge each tile is using
-    TileEdges *visitedTiles = calloc(game->roomHeight * game->roomWidth, sizeof(TileEdges));
-    // TODO: do this better
-    // Edge *edges = calloc(200, sizeof(Edge));
-    // iterate through all tiles in room
-    int edgeIndex = 0;
-    for (int x = 0; x < game->roomWidth; x++)
+/*
+Give each west or east face in a word its edge: the edge of the tile above when it has the same face, a new one otherwise.
+aboveFaces are the same side's faces of the row above. On the first row of a band the tile above belongs to another
+band, which may not have its ids yet, so a continued face is marked EDGE_ID_PENDING for stitchEdgeBands.
+Returns the next free edge id
+*/
+static int extractColumnRuns(GameState *game, uint64_t faces, uint64_t aboveFaces, int word, int y, Direction side, int edgeIndex, bool firstBandRow)
+{
+    TileEdges *tileEdges = game->roomTileEdges + y * game->roomWidth;
+    float tileSize = game->tileSize;
+    for (; faces; faces &= faces - 1)
     {
-        for (int y = 0; y < game->roomHeight; y++)
+        int bit = countTrailingZeros64(faces);
+        int x = word * ROW_WORD_BITS + bit;
+        Vector2 tilePosition = GET_TILE_POSITION(game, x, y);
+        float faceX = tilePosition.x + (side == DIRECTION_EAST ? tileSize : 0);
+
+        int edgeId;
+        if ((aboveFaces >> bit) & 1)
         {
-            // get array indicies for each neighboring tile
-            // can access a 1d array like a 2d array using the formula
-            // (y * width) + x
-            int i = ((y)*game->roomWidth) + (x);
-            int north = ((y - 1) * game->roomWidth) + (x);
-            int south = ((y + 1) * game->roomWidth) + (x);
-            int east = ((y)*game->roomWidth) + (x + 1);
-            int west = ((y)*game->roomWidth) + (x - 1);
-
-            Tile thisTile = game->roomTiles[i];
-            // initialize tileEdges for this tile
-            visitedTiles[i].isWall = false;
-            visitedTiles[i].northEdgeId = -1;
-            visitedTiles[i].southEdgeId = -1;
-            visitedTiles[i].eastEdgeId = -1;
-            visitedTiles[i].westEdgeId = -1;
-            // if this tile is a wall, calculate its edges
-            if (thisTile.tileType == TILE_WALL)
+            edgeId = firstBandRow ? EDGE_ID_PENDING : *getTileEdgeId(&tileEdges[x - game->roomWidth], side);
+        }
+        else
+        {
+            edgeId = edgeIndex++;
+            game->roomEdges[edgeId].visited = true;
+            game->roomEdges[edgeId].start = (Vector2){faceX, tilePosition.y};
+        }
+        if (edgeId != EDGE_ID_PENDING)
+            game->roomEdges[edgeId].end = (Vector2){faceX, tilePosition.y + tileSize};
+        *getTileEdgeId(&tileEdges[x], side) = edgeId;
+    }
+    return edgeIndex;
+}
+
+// Pack the opaque flags of the band's rows into bits
+static void packEdgeBandRows(EdgeBand *band)
+{
+    GameState *game = band->game;
+    uint64_t *rows = band->rows + band->firstRow * band->wordsPerRow;
+    memset(rows, 0, (size_t)(band->endRow - band->firstRow) * band->wordsPerRow * sizeof(uint64_t));
+    for (int y = band->firstRow; y < band->endRow; y++)
+    {
+        Tile *tiles = &GET_TILE(game, 0, y);
+        uint64_t *row = band->rows + y * band->wordsPerRow;
+        for (int x = 0; x < game->roomWidth; x++)
+        {
+            row[x / ROW_WORD_BITS] |= (uint64_t)((tiles[x].flags & TILE_FLAG_OPAQUE) != 0) << (x % ROW_WORD_BITS);
+        }
+    }
+}
+
+/*
+Count the edges that start in the band: a north/south run starts where the face to its west is missing,
+a west/east run where the face above is missing. The row above the band counts, so an edge carried on from
+the band above isn't counted twice, and every band's count is what a single pass over the room would give it
+*/
+static void countEdgeBandEdges(EdgeBand *band)
+{
+    int edgeCount = 0;
+    for (int y = band->firstRow; y < band->endRow; y++)
+    {
+        uint64_t northCarry = 0;
+        uint64_t southCarry = 0;
+        for (int word = 0; word < band->wordsPerRow; word++)
+        {
+            uint64_t faces[4];
+            uint64_t aboveFaces[4] = {0};
+            getRowWordFaces(band->rows, band->wordsPerRow, y, word, faces);
+            if (y > 0)
+                getRowWordFaces(band->rows, band->wordsPerRow, y - 1, word, aboveFaces);
+            edgeCount += countBits64(faces[DIRECTION_NORTH] & ~((faces[DIRECTION_NORTH] << 1) | northCarry));
+            edgeCount += countBits64(faces[DIRECTION_SOUTH] & ~((faces[DIRECTION_SOUTH] << 1) | southCarry));
+            edgeCount += countBits64(faces[DIRECTION_WEST] & ~aboveFaces[DIRECTION_WEST]);
+            edgeCount += countBits64(faces[DIRECTION_EAST] & ~aboveFaces[DIRECTION_EAST]);
+            northCarry = faces[DIRECTION_NORTH] >> (ROW_WORD_BITS - 1);
+            southCarry = faces[DIRECTION_SOUTH] >> (ROW_WORD_BITS - 1);
+        }
+    }
+    band->edgeCount = edgeCount;
+}
+
+// Fill in the edges and tile edge ids of the band's rows, giving out ids from band->firstEdgeId
+static void extractEdgeBand(EdgeBand *band)
+{
+    GameState *game = band->game;
+    // rows are walked in memory order, the edges of a row only need the ids already given to the row above
+    int edgeIndex = band->firstEdgeId;
+    for (int y = band->firstRow; y < band->endRow; y++)
+    {
+        TileEdges *tileEdges = game->roomTileEdges + y * game->roomWidth;
+        for (int x = 0; x < game->roomWidth; x++)
+        {
+            tileEdges[x] = (TileEdges){false, -1, -1, -1, -1};
+        }
+
+        bool firstBandRow = y == band->firstRow;
+        int openNorthEdgeId = -1;
+        int openSouthEdgeId = -1;
+        for (int word = 0; word < band->wordsPerRow; word++)
+        {
+            uint64_t faces[4];
+            uint64_t aboveFaces[4] = {0};
+            getRowWordFaces(band->rows, band->wordsPerRow, y, word, faces);
+            if (y > 0)
+                getRowWordFaces(band->rows, band->wordsPerRow, y - 1, word, aboveFaces);
+
+            for (uint64_t walls = band->rows[y * band->wordsPerRow + word]; walls; walls &= walls - 1)
             {
-                visitedTiles[i].isWall = true;
-                // does this tile have a western neighbor? if not, get a new western edge
-                // check if it is out of bounds first
-                if (x <= 0 || game->roomTiles[west].tileType != TILE_WALL)
-                {
-                    // if the tile has a northern neighbor with a western edge, can use its western edge
-                    if (y > 0 && game->roomTiles[north].tileType == TILE_WALL && visitedTiles[north].westEdgeId != -1)
-                    {
-
-                        // the northern neighbor has a western edge, which we can use now
-                        visitedTiles[i].westEdgeId = visitedTiles[north].westEdgeId;
-                        // extend the edge down
-                    }
-                    else
-                    {
-                        // create a new western edge
-                        visitedTiles[i].westEdgeId = edgeIndex;
-                        // set the edge start point
-                        edgeIndex++;
-                    }
-                }
-                // does this tile have a eastern neighbor? if not, get a new eastern edge
-                // check if it is out of bounds first
-                if (x == game->roomWidth - 1 || game->roomTiles[east].tileType != TILE_WALL)
-                {
-                    // if the tile has a northern neighbor with a eastern edge, can use its eastern edge
-                    if (y > 0 && game->roomTiles[north].tileType == TILE_WALL && visitedTiles[north].eastEdgeId != -1)
-                    {
-
-                        // the northern neighbor has a eastern edge, which we can use now
-                        visitedTiles[i].eastEdgeId = visitedTiles[north].eastEdgeId;
-                        // extend the edge down
-                    }
-                    else
-                    {
-                        // create a new eastern edge
-                        visitedTiles[i].eastEdgeId = edgeIndex;
-                        // set the edge start point
-                        edgeIndex++;
-                    }
-                }
-                // does this tile have a northern neighbor? if not, get a new northern edge
-                // check if it is out of bounds first
-                if (y <= 0 || game->roomTiles[north].tileType != TILE_WALL)
-                {
-                    // if the tile has a western neighbor with a western edge, can use its northern edge
-                    if (x > 0 && game->roomTiles[west].tileType == TILE_WALL && visitedTiles[west].northEdgeId != -1)
-                    {
-
-                        // the western neighbor has a northern edge, which we can use now
-                        visitedTiles[i].northEdgeId = visitedTiles[west].northEdgeId;
-                        // extend the edge down
-                    }
-                    else
-                    {
-                        // create a new northern edge
-                        visitedTiles[i].northEdgeId = edgeIndex;
-                        // set the edge start point
-                        edgeIndex++;
-                    }
-                }
-                // does this tile have a southern neighbor? if not, get a new southern edge
-                // check if it is out of bounds first
-                if (y == game->roomHeight - 1 || game->roomTiles[south].tileType != TILE_WALL)
-                {
-                    // if the tile has a western neighbor with a southern edge, can use its southern edge
-                    if (x > 0 && game->roomTiles[west].tileType == TILE_WALL && visitedTiles[west].southEdgeId != -1)
-                    {
-
-                        // the western neighbor has a western edge, which we can use now
-                        visitedTiles[i].southEdgeId = visitedTiles[west].southEdgeId;
-                        // extend the edge down
-                    }
-                    else
-                    {
-                        // create a new western edge
-                        visitedTiles[i].southEdgeId = edgeIndex;
-                        // set the edge start point
-                        edgeIndex++;
-                    }
-                }
+                tileEdges[word * ROW_WORD_BITS + countTrailingZeros64(walls)].isWall = true;
             }
+            edgeIndex = extractColumnRuns(game, faces[DIRECTION_WEST], aboveFaces[DIRECTION_WEST], word, y, DIRECTION_WEST, edgeIndex, firstBandRow);
+            edgeIndex = extractColumnRuns(game, faces[DIRECTION_EAST], aboveFaces[DIRECTION_EAST], word, y, DIRECTION_EAST, edgeIndex, firstBandRow);
+            edgeIndex = extractRowRuns(game, faces[DIRECTION_NORTH], word, y, DIRECTION_NORTH, edgeIndex, &openNorthEdgeId);
+            edgeIndex = extractRowRuns(game, faces[DIRECTION_SOUTH], word, y, DIRECTION_SOUTH, edgeIndex, &openSouthEdgeId);
         }
     }
-    // TODO: build the list of edges now
-    // iterate back through the list of visited tiles, extending them as we go
-    Edge *edges = calloc(edgeIndex + 1, sizeof(Edge));
+}
 
-    for (int x = 0; x < game->roomWidth; x++)
+static void *runEdgeBandStep(void *arg)
+{
+    EdgeBand *band = (EdgeBand *)arg;
+    switch (band->step)
     {
-        for (int y = 0; y < game->roomHeight; y++)
+    case EDGE_BAND_PACK:
+        packEdgeBandRows(band);
+        break;
+    case EDGE_BAND_COUNT:
+        countEdgeBandEdges(band);
+        break;
+    default:
+        extractEdgeBand(band);
+        break;
+    }
+    return NULL;
+}
+
+// Run one step on every band, each on its own thread, and wait for all of them. The calling thread takes the first band
+static void runEdgeBands(EdgeBand *bands, int bandCount, EdgeBandStep step)
+{
+    pthread_t threads[MAX_EDGE_BANDS];
+    bool started[MAX_EDGE_BANDS] = {false};
+    for (int i = 0; i < bandCount; i++)
+    {
+        bands[i].step = step;
+    }
+    for (int i = 1; i < bandCount; i++)
+    {
+        started[i] = pthread_create(&threads[i], NULL, runEdgeBandStep, &bands[i]) == 0;
+    }
+    runEdgeBandStep(&bands[0]);
+    for (int i = 1; i < bandCount; i++)
+    {
+        if (started[i])
+            pthread_join(threads[i], NULL);
+        else
+            runEdgeBandStep(&bands[i]); // out of threads, do it here
+    }
+}
+
+/*
+Join the west/east faces on the first row of each band to the edge of the tile above them.
+The bands are done top to bottom, so the tile above already has its final id, even when the edge
+runs through several bands. Ids were given out as in a single pass, so only the edges' ends change.
+*/
+static void stitchEdgeBands(GameState *game, EdgeBand *bands, int bandCount)
+{
+    static const Direction sides[2] = {DIRECTION_WEST, DIRECTION_EAST};
+    int width = game->roomWidth;
+    for (int b = 1; b < bandCount; b++)
+    {
+        for (int x = 0; x < width; x++)
         {
-            // calculate each edge's start point, or increase its end point
-            int i = ((y)*game->roomWidth) + (x);
-            // north edge
-            if (visitedTiles[i].northEdgeId != -1)
+            for (int s = 0; s < 2; s++)
             {
-                if (edges[visitedTiles[i].northEdgeId].visited)
+                Direction side = sides[s];
+                int y = bands[b].firstRow;
+                if (*getTileEdgeId(&game->roomTileEdges[y * width + x], side) != EDGE_ID_PENDING)
+                    continue;
+                int edgeId = *getTileEdgeId(&game->roomTileEdges[(y - 1) * width + x], side);
+                for (; y < bands[b].endRow; y++)
                 {
-                    // update endpoints of edge
-                    edges[visitedTiles[i].northEdgeId].end.x = game->roomTiles[i].position.x + game->tileSize;
-                    edges[visitedTiles[i].northEdgeId].end.y = game->roomTiles[i].position.y;
-                }
-                else
-                {
-                    // populate start points of edge
-                    edges[visitedTiles[i].northEdgeId].visited = true;
-                    edges[visitedTiles[i].northEdgeId].start.x = game->roomTiles[i].position.x;
-                    edges[visitedTiles[i].northEdgeId].start.y = game->roomTiles[i].position.y;
-                    edges[visitedTiles[i].northEdgeId].end.x = game->roomTiles[i].position.x + game->tileSize;
-                    edges[visitedTiles[i].northEdgeId].end.y = game->roomTiles[i].position.y;
+                    int *tileEdgeId = getTileEdgeId(&game->roomTileEdges[y * width + x], side);
+                    if (*tileEdgeId != EDGE_ID_PENDING)
+                        break;
+                    *tileEdgeId = edgeId;
                 }
+                game->roomEdges[edgeId].end.y = y * game->tileSize;
             }
-            // south edge
-            if (visitedTiles[i].southEdgeId != -1)
-            {
+        }
+    }
+}
 
-                if (edges[visitedTiles[i].southEdgeId].visited)
-                {
-                    // update endpoints of edge
-                    edges[visitedTiles[i].southEdgeId].end.x = game->roomTiles[i].position.x + game->tileSize;
-                    edges[visitedTiles[i].southEdgeId].end.y = game->roomTiles[i].position.y + game->tileSize;
-                }
-                else
-                {
-                    // populate start points of edge
-                    edges[visitedTiles[i].southEdgeId].visited = true;
-                    edges[visitedTiles[i].southEdgeId].start.x = game->roomTiles[i].position.x;
-                    edges[visitedTiles[i].southEdgeId].start.y = game->roomTiles[i].position.y + game->tileSize;
-                    edges[visitedTiles[i].southEdgeId].end.x = game->roomTiles[i].position.x + game->tileSize;
-                    edges[visitedTiles[i].southEdgeId].end.y = game->roomTiles[i].position.y + game->tileSize;
-                }
-            }
-            // east edge
-            if (visitedTiles[i].eastEdgeId != -1)
-            {
+// How many bands roomTilesToRoomLines splits the room into, one per core for big rooms
+static int getEdgeBandCount(GameState *game)
+{
+    if ((long)game->roomWidth * game->roomHeight < PARALLEL_EDGE_MIN_TILES)
+        return 1;
+    int coreCount = 4;
+#ifdef _SC_NPROCESSORS_ONLN
+    coreCount = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    return coreCount;
+}
 
-                if (edges[visitedTiles[i].eastEdgeId].visited)
-                {
-                    // update endpoints of edge
-                    edges[visitedTiles[i].eastEdgeId].end.x = game->roomTiles[i].position.x + game->tileSize;
-                    edges[visitedTiles[i].eastEdgeId].end.y = game->roomTiles[i].position.y + game->tileSize;
-                }
-                else
-                {
-                    // populate start points of edge
-                    edges[visitedTiles[i].eastEdgeId].visited = true;
-                    edges[visitedTiles[i].eastEdgeId].start.x = game->roomTiles[i].position.x + game->tileSize;
-                    edges[visitedTiles[i].eastEdgeId].start.y = game->roomTiles[i].position.y;
-                    edges[visitedTiles[i].eastEdgeId].end.x = game->roomTiles[i].position.x + game->tileSize;
-                    edges[visitedTiles[i].eastEdgeId].end.y = game->roomTiles[i].position.y + game->tileSize;
-                }
-            }
-            // west edge
-            if (visitedTiles[i].westEdgeId != -1)
+/*
+    Given a 1D array of tiles, identify all contiguous edges of each group of tiles
+    This greatly reduces the number of points to check when calculating shadows
+
+    The opaque tiles are packed into a bitboard, one bit per tile and 64 tiles per word, and the faces of a whole word
+    are found with shifts against the words next to it and the rows above and below. Runs of faces are then walked
+    with count trailing zeros, so the per tile work is only done for tiles that actually have a face.
+
+    Big rooms are split into bands of rows done on their own threads, see roomTilesToRoomLinesBanded
+
+    For now, just operate on whole room
+*/
+void roomTilesToRoomLines(GameState *game)
+{
+    roomTilesToRoomLinesBanded(game, getEdgeBandCount(game));
+}
+
+/*
+Same as roomTilesToRoomLines, with the room split into bandCount horizontal bands extracted in parallel.
+Each band counts its edges first, so it can give out the same ids a single pass would, and the edges
+crossing into a band from the one above are stitched afterwards. The result is the same whatever the band count
+*/
+void roomTilesToRoomLinesBanded(GameState *game, int bandCount)
+{
+    // only timed here on the calling thread, the band threads are too short lived to get a profiler ring each
+    PROFILE_BEGIN(roomTilesToRoomLines);
+    int width = game->roomWidth;
+    int height = game->roomHeight;
+    int wordsPerRow = (width + ROW_WORD_BITS - 1) / ROW_WORD_BITS;
+    if (bandCount > MAX_EDGE_BANDS)
+        bandCount = MAX_EDGE_BANDS;
+    if (bandCount > height / MIN_EDGE_BAND_ROWS)
+        bandCount = height / MIN_EDGE_BAND_ROWS;
+    if (bandCount < 1)
+        bandCount = 1;
+
+    // opaque bits of every row, with an empty row above and below the room
+    ArenaMark mark = arenaMark(game->frameArena);
+    uint64_t *rows = arenaAlloc(game->frameArena, (size_t)(height + 2) * wordsPerRow * sizeof(uint64_t));
+    memset(rows, 0, wordsPerRow * sizeof(uint64_t));
+    memset(rows + (size_t)(height + 1) * wordsPerRow, 0, wordsPerRow * sizeof(uint64_t));
+    rows += wordsPerRow;
+
+    EdgeBand bands[MAX_EDGE_BANDS];
+    for (int i = 0; i < bandCount; i++)
+    {
+        bands[i] = (EdgeBand){game, rows, wordsPerRow, height * i / bandCount, height * (i + 1) / bandCount};
+    }
+    runEdgeBands(bands, bandCount, EDGE_BAND_PACK);
+    runEdgeBands(bands, bandCount, EDGE_BAND_COUNT);
+
+    int edgeCount = 0;
+    for (int i = 0; i < bandCount; i++)
+    {
+        bands[i].firstEdgeId = edgeCount;
+        edgeCount += bands[i].edgeCount;
+    }
+
+    // used to track which edge each tile is using. every entry is filled in by the bands, so the old buffer can be reused
+    game->roomTileEdges = growBuffer(game->frameArena, game->roomTileEdges, &game->roomTileEdgeCapacity, height * width, sizeof(TileEdges));
+    game->roomEdges = growBuffer(game->frameArena, game->roomEdges, &game->roomEdgeCapacity, edgeCount + 1, sizeof(Edge));
+    Edge *edges = game->roomEdges;
+    memset(edges, 0, (edgeCount + 1) * sizeof(Edge));
+
+    runEdgeBands(bands, bandCount, EDGE_BAND_EXTRACT);
+    stitchEdgeBands(game, bands, bandCount);
+    arenaRelease(game->frameArena, mark);
+
+    game->roomEdgeCount = edgeCount;
+    game->freeEdgeCount = 0;
+    // anything calculated from the old edges (cached visibility) is now stale
+    game->roomEdgeVersion++;
+    // the per tile edge ids stay in game->roomTileEdges so rays can look up the edges of the tiles they pass through
+    // and a SoA copy of the edges for the SIMD ray caster
+    if (game->roomEdgeBuffer == NULL)
+    {
+        game->roomEdgeBuffer = calloc(1, sizeof(EdgeBuffer));
+    }
+    buildEdgeBuffer(game->roomEdgeBuffer, edges, edgeCount);
+    PROFILE_END(roomTilesToRoomLines);
+}
+
+// Does the tile have an exposed face on this side? Same rule as roomTilesToRoomLines: an opaque tile next to a see-through one or the room bounds
+static bool tileHasFace(GameState *game, int x, int y, Direction side)
+{
+    if (x < 0 || x >= game->roomWidth || y < 0 || y >= game->roomHeight)
+        return false;
+    if (!(GET_TILE(game, x, y).flags & TILE_FLAG_OPAQUE))
+        return false;
+
+    int neighborX = x + (side == DIRECTION_EAST) - (side == DIRECTION_WEST);
+    int neighborY = y + (side == DIRECTION_SOUTH) - (side == DIRECTION_NORTH);
+    if (neighborX < 0 || neighborX >= game->roomWidth || neighborY < 0 || neighborY >= game->roomHeight)
+        return true;
+    return !(GET_TILE(game, neighborX, neighborY).flags & TILE_FLAG_OPAQUE);
+}
+
+// Take an edge id from the free list, or add one at the end of roomEdges
+static int allocateEdge(GameState *game)
+{
+    if (game->freeEdgeCount > 0)
+    {
+        game->freeEdgeCount--;
+        return game->freeEdgeIds[game->freeEdgeCount];
+    }
+    game->roomEdges = growBuffer(game->frameArena, game->roomEdges, &game->roomEdgeCapacity, game->roomEdgeCount + 1, sizeof(Edge));
+    game->roomEdgeCount++;
+    return game->roomEdgeCount - 1;
+}
+
+// Empty an edge slot and put its id on the free list. The slot keeps no length, so rays never hit it
+static void releaseEdge(GameState *game, int edgeId)
+{
+    game->roomEdges[edgeId] = (Edge){0};
+    game->freeEdgeIds = growBuffer(game->frameArena, game->freeEdgeIds, &game->freeEdgeCapacity, game->freeEdgeCount + 1, sizeof(int));
+    game->freeEdgeIds[game->freeEdgeCount] = edgeId;
+    game->freeEdgeCount++;
+    setEdgeBufferEdge(game->roomEdgeBuffer, edgeId, &game->roomEdges[edgeId]);
+}
+
+/*
+Rebuild the edges on one side of a line of tiles, around the tile (x, y).
+North/south faces run along a row, east/west faces along a column. Only the face of (x, y) can have changed,
+so only the edges through it and its two neighbours on the line are freed, and the tiles they covered are
+scanned again for runs of faces, same as roomTilesToRoomLines would merge them.
+*/
+static void rebuildEdgeLine(GameState *game, int x, int y, Direction side)
+{
+    if (x < 0 || x >= game->roomWidth || y < 0 || y >= game->roomHeight)
+        return;
+
+    bool alongRow = side == DIRECTION_NORTH || side == DIRECTION_SOUTH;
+    int stepX = alongRow ? 1 : 0;
+    int stepY = alongRow ? 0 : 1;
+    int lineLength = alongRow ? game->roomWidth : game->roomHeight;
+    int position = alongRow ? x : y;
+    int lineX = alongRow ? 0 : x; // tile at position 0 of the line
+    int lineY = alongRow ? y : 0;
+
+    // free the edges through the tile and its neighbours, growing the range to everything they covered
+    int first = position;
+    int last = position;
+    for (int offset = -1; offset <= 1; offset++)
+    {
+        int p = position + offset;
+        if (p < 0 || p >= lineLength)
+            continue;
+        int edgeId = *getTileEdgeId(&game->roomTileEdges[(lineY + p * stepY) * game->roomWidth + lineX + p * stepX], side);
+        if (edgeId == -1 || !game->roomEdges[edgeId].visited)
+            continue;
+        Edge *edge = &game->roomEdges[edgeId];
+        int edgeFirst = (int)((alongRow ? edge->start.x : edge->start.y) / game->tileSize);
+        int edgeLast = (int)((alongRow ? edge->end.x : edge->end.y) / game->tileSize) - 1;
+        if (edgeFirst < first)
+            first = edgeFirst;
+        if (edgeLast > last)
+            last = edgeLast;
+        releaseEdge(game, edgeId);
+    }
+
+    // scan the range again, one edge per run of faces
+    for (int p = first; p <= last; p++)
+    {
+        *getTileEdgeId(&game->roomTileEdges[(lineY + p * stepY) * game->roomWidth + lineX + p * stepX], side) = -1;
+    }
+    for (int p = first; p <= last; p++)
+    {
+        int tileX = lineX + p * stepX;
+        int tileY = lineY + p * stepY;
+        if (!tileHasFace(game, tileX, tileY, side))
+            continue;
+
+        int runEnd = p;
+        while (runEnd + 1 <= last && tileHasFace(game, lineX + (runEnd + 1) * stepX, lineY + (runEnd + 1) * stepY, side))
+            runEnd++;
+
+        int edgeId = allocateEdge(game);
+        Edge *edge = &game->roomEdges[edgeId];
+        float tileSize = game->tileSize;
+        // same corners roomTilesToRoomLines uses for each side
+        float startX = tileX * tileSize + (side == DIRECTION_EAST ? tileSize : 0);
+        float startY = tileY * tileSize + (side == DIRECTION_SOUTH ? tileSize : 0);
+        edge->visited = true;
+        edge->start = (Vector2){startX, startY};
+        edge->end = alongRow ? (Vector2){startX + (runEnd - p + 1) * tileSize, startY}
+                             : (Vector2){startX, startY + (runEnd - p + 1) * tileSize};
+        for (int q = p; q <= runEnd; q++)
+        {
+            *getTileEdgeId(&game->roomTileEdges[(lineY + q * stepY) * game->roomWidth + lineX + q * stepX], side) = edgeId;
+        }
+        setEdgeBufferEdge(game->roomEdgeBuffer, edgeId, edge);
+        p = runEnd;
+    }
+}
+
+/*
+Change one tile and update the room's edges incrementally, instead of rebuilding them all with roomTilesToRoomLines.
+Only edges touching the tile and its 4 neighbours are split, merged or removed. Other edges keep their ids,
+and freed ids are reused by the next edges created.
+*/
+void worldSetTile(GameState *game, int x, int y, TileType type)
+{
+    if (x < 0 || x >= game->roomWidth || y < 0 || y >= game->roomHeight)
+        return;
+    Tile *tile = &GET_TILE(game, x, y);
+    if (tile->tileType == (int)type)
+        return;
+    SetTileType(tile, type);
+    game->roomTileEdges[y * game->roomWidth + x].isWall = (tile->flags & TILE_FLAG_OPAQUE) != 0;
+    updateTileNeighborMasks(game, x, y);
+
+    // the tile's own faces, and the faces of its neighbours that point at it
+    rebuildEdgeLine(game, x, y, DIRECTION_NORTH);
+    rebuildEdgeLine(game, x, y, DIRECTION_SOUTH);
+    rebuildEdgeLine(game, x, y, DIRECTION_EAST);
+    rebuildEdgeLine(game, x, y, DIRECTION_WEST);
+    rebuildEdgeLine(game, x, y + 1, DIRECTION_NORTH);
+    rebuildEdgeLine(game, x, y - 1, DIRECTION_SOUTH);
+    rebuildEdgeLine(game, x - 1, y, DIRECTION_EAST);
+    rebuildEdgeLine(game, x + 1, y, DIRECTION_WEST);
+
+    game->roomEdgeVersion++;
+}
+
+// Distance from a point to the closest point of an edge
+static float distanceToEdge(Vector2 point, Edge *edge)
+{
+    float edgeX = edge->end.x - edge->start.x;
+    float edgeY = edge->end.y - edge->start.y;
+    float lengthSqr = edgeX * edgeX + edgeY * edgeY;
+    float u = 0;
+    if (lengthSqr > 0)
+    {
+        u = ((point.x - edge->start.x) * edgeX + (point.y - edge->start.y) * edgeY) / lengthSqr;
+        u = u < 0 ? 0 : (u > 1 ? 1 : u);
+    }
+    float dx = edge->start.x + edgeX * u - point.x;
+    float dy = edge->start.y + edgeY * u - point.y;
+    return sqrtf(dx * dx + dy * dy);
+}
+
+/*
+Collect the room edges within maxDistance of origin into one buffer, looking only at the tiles in range instead of
+every edge of the room. An edge covering several tiles is added from the first of them in range, so only once.
+Returns the number of edges
+*/
+int gatherRoomEdges(GameState *game, Vector2 origin, float maxDistance, Edge **edges, int *edgeCapacity)
+{
+    float tileSize = game->tileSize;
+    // one extra tile, a south or east face on the border belongs to the tile before it
+    int minX = (int)floorf((origin.x - maxDistance) / tileSize) - 1;
+    int minY = (int)floorf((origin.y - maxDistance) / tileSize) - 1;
+    int maxX = (int)floorf((origin.x + maxDistance) / tileSize) + 1;
+    int maxY = (int)floorf((origin.y + maxDistance) / tileSize) + 1;
+    minX = minX < 0 ? 0 : minX;
+    minY = minY < 0 ? 0 : minY;
+    maxX = maxX >= game->roomWidth ? game->roomWidth - 1 : maxX;
+    maxY = maxY >= game->roomHeight ? game->roomHeight - 1 : maxY;
+
+    int edgeCount = 0;
+    for (int y = minY; y <= maxY; y++)
+    {
+        for (int x = minX; x <= maxX; x++)
+        {
+            TileEdges *tileEdges = &game->roomTileEdges[y * game->roomWidth + x];
+            if (!tileEdges->isWall)
+                continue;
+            for (int side = DIRECTION_NORTH; side <= DIRECTION_WEST; side++)
             {
-                if (edges[visitedTiles[i].westEdgeId].visited)
-                {
-                    // update endpoints of edge
-                    edges[visitedTiles[i].westEdgeId].end.x = game->roomTiles[i].position.x;
-                    edges[visitedTiles[i].westEdgeId].end.y = game->roomTiles[i].position.y + game->tileSize;
-                }
-                else
-                {
-                    // populate start points of edge
-                    edges[visitedTiles[i].westEdgeId].visited = true;
-                    edges[visitedTiles[i].westEdgeId].start.x = game->roomTiles[i].position.x;
-                    edges[visitedTiles[i].westEdgeId].start.y = game->roomTiles[i].position.y;
-                    edges[visitedTiles[i].westEdgeId].end.x = game->roomTiles[i].position.x;
-                    edges[visitedTiles[i].westEdgeId].end.y = game->roomTiles[i].position.y + game->tileSize;
-                }
+                int edgeId = *getTileEdgeId(tileEdges, side);
+                if (edgeId == -1)
+                    continue;
+                Edge *edge = &game->roomEdges[edgeId];
+                bool alongRow = side == DIRECTION_NORTH || side == DIRECTION_SOUTH;
+                int edgeFirst = (int)((alongRow ? edge->start.x : edge->start.y) / tileSize);
+                int scanFirst = alongRow ? minX : minY;
+                if ((alongRow ? x : y) != (edgeFirst > scanFirst ? edgeFirst : scanFirst))
+                    continue;
+                if (distanceToEdge(origin, edge) > maxDistance)
+                    continue;
+
+                *edges = growBuffer(game->frameArena, *edges, edgeCapacity, edgeCount + 1, sizeof(Edge));
+                (*edges)[edgeCount] = *edge;
+                edgeCount++;
             }
         }
     }
-    game->roomEdges = edges;
-    game->roomEdgeCount = edgeIndex;
-    free(visitedTiles);
-}
\ No newline at end of file
+    return edgeCount;
+}
@@ -3,22 +3,55 @@
 
 #include "raylib.h"
 #include "game_state.h"
+#include <stdint.h>
 
 // Forward declarations
 
 // Structs
 
+// Sides of a tile
+typedef enum Direction
+{
+    DIRECTION_NORTH = 0,
+    DIRECTION_EAST = 1,
+    DIRECTION_SOUTH = 2,
+    DIRECTION_WEST = 3
+} Direction;
+
+// Bits of a tile's neighbour mask, set for each neighbour of the same type
+#define NEIGHBOR_NORTH (1 << 0)
+#define NEIGHBOR_EAST (1 << 1)
+#define NEIGHBOR_SOUTH (1 << 2)
+#define NEIGHBOR_WEST (1 << 3)
+#define NEIGHBOR_NORTH_WEST (1 << 4)
+#define NEIGHBOR_NORTH_EAST (1 << 5)
+#define NEIGHBOR_SOUTH_WEST (1 << 6)
+#define NEIGHBOR_SOUTH_EAST (1 << 7)
+// x, y offset of the neighbour for each bit of the mask
+static const int NEIGHBOR_OFFSETS[8][2] = {{0, -1}, {1, 0}, {0, 1}, {-1, 0}, {-1, -1}, {1, -1}, {-1, 1}, {1, 1}};
+
+// Tile layers are baked at the tileset's own resolution, and scaled up to tileSize when drawn
+#define TILE_LAYER_PIXELS 16
+// the room's tile layer is split in square blocks of this many tiles, so only the blocks on screen need a texture
+#define TILE_LAYER_BLOCK_SIZE 32
+// Gets the type and neighbour mask of tile (x, y) of a tile layer, for bakeTileLayer
+typedef void (*TileLayerSource)(void *source, int x, int y, int *tileType, unsigned char *neighborMask);
+
 // Static tile definitions
 static const TileProperties TILE_DEFINITIONS[TILE_COUNT] = {
-    [TILE_FLOOR] = {TILE_FLOOR, DARKGREEN, false, "Floor"},
-    [TILE_WALL] = {TILE_WALL, DARKGRAY, false, "Wall"}};
+    [TILE_FLOOR] = {TILE_FLOOR, DARKGREEN, false, false, "Floor"},
+    [TILE_WALL] = {TILE_WALL, DARKGRAY, false, true, "Wall"}};
 
-// Tile: one tile of the world map
+// Bits of Tile.flags, copied from the tile type's properties so scans don't need the table
+#define TILE_FLAG_SOLID (1 << 0)
+#define TILE_FLAG_OPAQUE (1 << 1)
+
+// Tile: one tile of the world map. 3 bytes, the position comes from the index (see GET_TILE_POSITION)
 typedef struct Tile
 {
-    int tileType;
-    Vector2 position;
-
+    uint8_t tileType;     // TileType
+    uint8_t flags;        // TILE_FLAG_ bits
+    uint8_t neighborMask; // NEIGHBOR_ bits, kept up to date by loadRoomTiles and worldSetTile
 } Tile;
 
 typedef struct TileCorners
@@ -31,7 +64,7 @@ typedef struct TileCorners
 
 typedef struct Edge
 {
-    bool visited;
+    bool visited; // false for unused slots (freed by worldSetTile), which have no length
     Vector2 start;
     Vector2 end;
 } Edge;
@@ -47,8 +80,19 @@ typedef struct TileEdges
 
 // Functions
 void loadRoomTiles(GameState *game, int roomWidth, int roomHeight);
+void computeRoomNeighborMasks(GameState *game);
 void drawRoomTiles(GameState *game);
 void roomTilesToRoomLines(GameState *game);
+void roomTilesToRoomLinesBanded(GameState *game, int bandCount);
+void worldSetTile(GameState *game, int x, int y, TileType type);
+void initTileCornersTable(void);
+TileCorners getTileCornersForMask(unsigned char neighborMask);
+void drawTile(GameState *game, int tileType, unsigned char neighborMask, Vector2 position, float size);
+void bakeTileLayer(GameState *game, RenderTexture2D layer, TileRegion region, TileLayerSource getTile, void *source);
+void drawTileLayer(RenderTexture2D layer, Rectangle destRect);
+void bakeRoomTileLayer(GameState *game);
+void unloadRoomTileLayers(GameState *game);
+int gatherRoomEdges(GameState *game, Vector2 origin, float maxDistance, Edge **edges, int *edgeCapacity);
 // Helper functions
 static inline TileProperties GetTileProperties(TileType type)
 {
@@ -62,9 +106,27 @@ static inline bool IsTileTypeSolid(TileType type)
     return GetTileProperties(type).isSolid;
 }
 
+static inline bool IsTileTypeOpaque(TileType type)
+{
+    return GetTileProperties(type).isOpaque;
+}
+
 static inline Color GetTileColor(TileType type)
 {
     return GetTileProperties(type).color;
 }
 
+static inline uint8_t GetTileFlags(TileType type)
+{
+    TileProperties properties = GetTileProperties(type);
+    return (properties.isSolid ? TILE_FLAG_SOLID : 0) | (properties.isOpaque ? TILE_FLAG_OPAQUE : 0);
+}
+
+// Set a tile's type, and the flags that go with it
+static inline void SetTileType(Tile *tile, TileType type)
+{
+    tile->tileType = type;
+    tile->flags = GetTileFlags(type);
+}
+
 #endif
\ No newline at end of file